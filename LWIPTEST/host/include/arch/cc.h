@@ -0,0 +1,54 @@
+/*
+ * arch/cc.h
+ *
+ * Host build: lwIP types for a little-endian LP64 host, in place of the
+ * AVR32 ones of the port. Assertions abort the test program.
+ */
+
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Define platform endianness */
+#ifndef BYTE_ORDER
+#define BYTE_ORDER LITTLE_ENDIAN
+#endif /* BYTE_ORDER */
+
+/* Define generic types used in lwIP */
+typedef uint8_t    u8_t;
+typedef int8_t     s8_t;
+typedef uint16_t   u16_t;
+typedef int16_t    s16_t;
+typedef uint32_t   u32_t;
+typedef int32_t    s32_t;
+
+typedef uintptr_t mem_ptr_t;
+
+/* Define (sn)printf formatters for these lwIP types */
+#define U16_F "hu"
+#define S16_F "hd"
+#define X16_F "hx"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+#define SZT_F "zu"
+
+/* Compiler hints for packing structures */
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__ ((__packed__))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#define  LWIP_COMPAT_MUTEX  1
+
+/* Plaform specific diagnostic output */
+#define LWIP_PLATFORM_DIAG(x) do { printf x; } while(0)
+
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "Assertion \"%s\" failed at line %d in %s\n", \
+                                             x, __LINE__, __FILE__); fflush(NULL); abort(); } while(0)
+
+#define LWIP_PROVIDE_ERRNO // Make lwip/arch.h define the codes which are used throughout.
+#endif /* __ARCH_CC_H__ */
@@ -0,0 +1,160 @@
+/*
+ * avr32/io.h
+ *
+ * Host replacement for the toolchain part header: the peripherals used by
+ * the network code are plain structures in memory, AVR32_MACB being driven
+ * by the simulated DMA engine of sim/sim_macb.c. Only the registers and bits
+ * the sources under test use are declared, with the AT32UC3A0512 values.
+ */
+
+#ifndef _HOST_AVR32_IO_H_
+#define _HOST_AVR32_IO_H_
+
+/* Interrupt handlers are ordinary functions, called by the simulation. */
+#define __interrupt__			used
+
+/* System registers: no status register, no cycle counter. */
+#define AVR32_SR			0
+#define AVR32_SR_GM_OFFSET		16
+#define AVR32_SR_GM_MASK		0x00010000
+#define AVR32_COUNT			66
+#define AVR32_COMPARE			67
+#define AVR32_CORE_COMPARE_IRQ		0
+
+static inline unsigned long __builtin_mfsr(int reg) { (void)reg; return 0; }
+static inline void __builtin_mtsr(int reg, unsigned long value) { (void)reg; (void)value; }
+static inline void __builtin_ssrf(int bit) { (void)bit; }
+static inline void __builtin_csrf(int bit) { (void)bit; }
+
+/* Interrupt controller */
+#define AVR32_INTC_INT0			0
+#define AVR32_INTC_INT1			1
+#define AVR32_INTC_INT2			2
+#define AVR32_INTC_INT3			3
+
+/* MACB */
+typedef struct
+{
+	volatile unsigned long ncr, ncfgr, nsr;
+	volatile unsigned long tsr, rbqp, tbqp, rsr;
+	volatile unsigned long isr, ier, idr, imr;
+	volatile unsigned long man;
+	volatile unsigned long hrb, hrt;
+	volatile unsigned long sa1b, sa1t;
+	volatile unsigned long usrio;
+} avr32_macb_t;
+
+extern avr32_macb_t AVR32_MACB;
+
+#define AVR32_MACB_IRQ			64
+
+#define AVR32_MACB_NCR_RE_MASK		0x00000004
+#define AVR32_MACB_NCR_TE_MASK		0x00000008
+#define AVR32_MACB_NCR_MPE_MASK		0x00000010
+#define AVR32_MACB_TSTART_MASK		0x00000200
+#define AVR32_MACB_RE_OFFSET		2
+#define AVR32_MACB_TE_OFFSET		3
+
+#define AVR32_MACB_SPD_MASK		0x00000001
+#define AVR32_MACB_FD_MASK		0x00000002
+#define AVR32_MACB_NCFGR_NBC_MASK	0x00000020
+#define AVR32_MACB_NCFGR_MTI_MASK	0x00000040
+#define AVR32_MACB_NCFGR_CLK_OFFSET	10
+#define AVR32_MACB_NCFGR_CLK_DIV8	0
+#define AVR32_MACB_NCFGR_CLK_DIV16	1
+#define AVR32_MACB_NCFGR_CLK_DIV32	2
+#define AVR32_MACB_NCFGR_CLK_DIV64	3
+#define AVR32_MACB_NCFGR_DRFCS_MASK	0x00020000
+
+#define AVR32_MACB_NSR_IDLE_MASK	0x00000004
+
+#define AVR32_MACB_TSR_RLE_MASK		0x00000004
+#define AVR32_MACB_TSR_BEX_MASK		0x00000010
+#define AVR32_MACB_TSR_COMP_MASK	0x00000020
+#define AVR32_MACB_TSR_UND_MASK		0x00000040
+
+#define AVR32_MACB_RSR_BNA_MASK		0x00000001
+#define AVR32_MACB_BNA_MASK		0x00000001
+#define AVR32_MACB_REC_MASK		0x00000002
+#define AVR32_MACB_RSR_OVR_MASK		0x00000004
+
+#define AVR32_MACB_IER_RCOMP_MASK	0x00000002
+#define AVR32_MACB_IDR_RCOMP_MASK	0x00000002
+#define AVR32_MACB_IER_TUND_MASK	0x00000010
+#define AVR32_MACB_ISR_TUND_MASK	0x00000010
+#define AVR32_MACB_IER_RLE_MASK		0x00000020
+#define AVR32_MACB_ISR_RLE_MASK		0x00000020
+#define AVR32_MACB_IER_TCOMP_MASK	0x00000080
+#define AVR32_MACB_TCOMP_MASK		0x00000080
+
+#define AVR32_MACB_SOF_MASK		0xc0000000
+#define AVR32_MACB_SOF_OFFSET		30
+#define AVR32_MACB_RW_OFFSET		28
+#define AVR32_MACB_PHYA_OFFSET		23
+#define AVR32_MACB_REGA_OFFSET		18
+#define AVR32_MACB_CODE_OFFSET		16
+
+#define AVR32_MACB_RMII_MASK		0x00000001
+
+/* MACB pins, routed by the GPIO stubs */
+#define AVR32_MACB_MDC_0_PIN		0
+#define AVR32_MACB_MDC_0_FUNCTION	0
+#define AVR32_MACB_MDIO_0_PIN		0
+#define AVR32_MACB_MDIO_0_FUNCTION	0
+#define AVR32_MACB_RXD_0_PIN		0
+#define AVR32_MACB_RXD_0_FUNCTION	0
+#define AVR32_MACB_RXD_1_PIN		0
+#define AVR32_MACB_RXD_1_FUNCTION	0
+#define AVR32_MACB_RX_DV_0_PIN		0
+#define AVR32_MACB_RX_DV_0_FUNCTION	0
+#define AVR32_MACB_RX_ER_0_PIN		0
+#define AVR32_MACB_RX_ER_0_FUNCTION	0
+#define AVR32_MACB_TXD_0_PIN		0
+#define AVR32_MACB_TXD_0_FUNCTION	0
+#define AVR32_MACB_TXD_1_PIN		0
+#define AVR32_MACB_TXD_1_FUNCTION	0
+#define AVR32_MACB_TX_EN_0_PIN		0
+#define AVR32_MACB_TX_EN_0_FUNCTION	0
+#define AVR32_MACB_TX_CLK_0_PIN		0
+#define AVR32_MACB_TX_CLK_0_FUNCTION	0
+
+/* GPIO, for the PHY interrupt pin */
+typedef struct
+{
+	volatile unsigned long ierc, ifrc, ovrs, ovrc, pvr;
+} avr32_gpio_port_t;
+
+typedef struct
+{
+	avr32_gpio_port_t port[4];
+} avr32_gpio_t;
+
+extern avr32_gpio_t AVR32_GPIO;
+
+#define AVR32_GPIO_IRQ_0		(64 + 32)
+
+/* External interrupt controller, for the PHY interrupt */
+typedef struct
+{
+	volatile unsigned long ier, idr, imr, isr, icr;
+} avr32_eic_t;
+
+extern avr32_eic_t AVR32_EIC;
+
+#define AVR32_EIC_INT3			3
+#define AVR32_EIC_EXTINT_3_PIN		0
+#define AVR32_EIC_EXTINT_3_FUNCTION	0
+#define AVR32_EIC_IRQ_3			3
+
+#define AVR32_EIC_EDGE_IRQ		0
+#define AVR32_EIC_LEVEL_IRQ		1
+#define AVR32_EIC_FALLING_EDGE		0
+#define AVR32_EIC_RISING_EDGE		1
+#define AVR32_EIC_LOW_LEVEL		0
+#define AVR32_EIC_HIGH_LEVEL		1
+#define AVR32_EIC_FILTER_OFF		0
+#define AVR32_EIC_FILTER_ON		1
+#define AVR32_EIC_SYNC			0
+#define AVR32_EIC_USE_ASYNC		1
+
+#endif /* _HOST_AVR32_IO_H_ */
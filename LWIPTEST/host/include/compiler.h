@@ -0,0 +1,14 @@
+/*
+ * compiler.h
+ *
+ * Host build: the glibc headers and compiler.h both define __always_inline,
+ * the same way. Drop the glibc one so that compiler.h does not warn.
+ */
+
+#ifndef _HOST_COMPILER_H_
+#define _HOST_COMPILER_H_
+
+#undef __always_inline
+#include_next "compiler.h"
+
+#endif /* _HOST_COMPILER_H_ */
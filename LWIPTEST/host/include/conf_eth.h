@@ -0,0 +1,41 @@
+/*
+ * conf_eth.h
+ *
+ * Host build: the project configuration, with the hooks of the MACB driver
+ * routed to the simulated MACB. The HOST_xxx macros set from the command line
+ * select the driver variant a test is built for.
+ */
+
+#ifndef _HOST_CONF_ETH_H_
+#define _HOST_CONF_ETH_H_
+
+#include_next "conf_eth.h"
+
+#include "sim_macb.h"
+
+/* The PHY is not simulated: xMACBInit() must not wait for it. */
+#undef ETHERNET_CONF_PHY_ASYNC
+#define ETHERNET_CONF_PHY_ASYNC            1
+
+#ifdef HOST_RX_ZERO_COPY
+#undef ETHERNET_CONF_RX_ZERO_COPY
+#define ETHERNET_CONF_RX_ZERO_COPY         HOST_RX_ZERO_COPY
+#endif
+
+#ifdef HOST_TX_ZERO_COPY
+#undef ETHERNET_CONF_TX_ZERO_COPY
+#define ETHERNET_CONF_TX_ZERO_COPY         HOST_TX_ZERO_COPY
+#endif
+
+#ifdef HOST_TX_QUEUE_LEN
+#undef ETHERNET_CONF_TX_QUEUE_LEN
+#define ETHERNET_CONF_TX_QUEUE_LEN         HOST_TX_QUEUE_LEN
+#endif
+
+/* Let the simulated MACB send frames while the driver waits for a Tx buffer. */
+#define macbTX_BUFFER_WAIT()               sim_macb_tx_wait()
+
+/* The status registers are write-one-to-clear. */
+#define macbCLEAR_STATUS( reg, mask )      sim_macb_clear_status( &( reg ), ( mask ) )
+
+#endif /* _HOST_CONF_ETH_H_ */
@@ -0,0 +1,151 @@
+/*
+ * pcap.c
+ *
+ * Classic libpcap capture files, see pcap.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pcap.h"
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_NANO     0xa1b23c4d
+#define LINKTYPE_ETHERNET   1
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version_major, version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs, snaplen, network;
+} pcap_file_header_t;
+
+typedef struct
+{
+  uint32_t ts_sec, ts_frac, caplen, len;
+} pcap_record_header_t;
+
+static uint32_t prvSwap32(uint32_t x)
+{
+  return ( x >> 24 ) | ( ( x >> 8 ) & 0xff00 ) | ( ( x << 8 ) & 0xff0000 ) | ( x << 24 );
+}
+
+static uint32_t prvHost32(const sim_pcap_t *pxPcap, uint32_t x)
+{
+  return pxPcap->xSwapped ? prvSwap32( x ) : x;
+}
+
+bool sim_pcap_open_read(sim_pcap_t *pxPcap, const char *pcPath)
+{
+  pcap_file_header_t xHeader;
+
+  memset( pxPcap, 0, sizeof( *pxPcap ) );
+  pxPcap->pxFile = fopen( pcPath, "rb" );
+  if( pxPcap->pxFile == NULL )
+  {
+    return false;
+  }
+  if( fread( &xHeader, sizeof( xHeader ), 1, pxPcap->pxFile ) != 1 )
+  {
+    sim_pcap_close( pxPcap );
+    return false;
+  }
+
+  switch( xHeader.magic )
+  {
+  case PCAP_MAGIC:
+    break;
+  case PCAP_MAGIC_NANO:
+    pxPcap->xNano = true;
+    break;
+  default:
+    pxPcap->xSwapped = true;
+    if( prvSwap32( xHeader.magic ) == PCAP_MAGIC_NANO )
+    {
+      pxPcap->xNano = true;
+    }
+    else if( prvSwap32( xHeader.magic ) != PCAP_MAGIC )
+    {
+      sim_pcap_close( pxPcap );
+      return false;
+    }
+    break;
+  }
+
+  if( prvHost32( pxPcap, xHeader.network ) != LINKTYPE_ETHERNET )
+  {
+    sim_pcap_close( pxPcap );
+    return false;
+  }
+  return true;
+}
+
+long sim_pcap_read(sim_pcap_t *pxPcap, void *pvFrame, unsigned long ulMax, unsigned long long *pullTime)
+{
+  pcap_record_header_t xRecord;
+  unsigned long ulLength, ulKept;
+
+  if( fread( &xRecord, sizeof( xRecord ), 1, pxPcap->pxFile ) != 1 )
+  {
+    return feof( pxPcap->pxFile ) ? 0 : -1;
+  }
+  ulLength = prvHost32( pxPcap, xRecord.caplen );
+  if( ulLength > SIM_PCAP_SNAPLEN )
+  {
+    return -1;
+  }
+
+  ulKept = ( ulLength < ulMax ) ? ulLength : ulMax;
+  if( ( fread( pvFrame, 1, ulKept, pxPcap->pxFile ) != ulKept )
+    || ( fseek( pxPcap->pxFile, ulLength - ulKept, SEEK_CUR ) != 0 ) )
+  {
+    return -1;
+  }
+
+  if( pullTime != NULL )
+  {
+    *pullTime = ( unsigned long long )prvHost32( pxPcap, xRecord.ts_sec ) * 1000000
+              + prvHost32( pxPcap, xRecord.ts_frac ) / ( pxPcap->xNano ? 1000 : 1 );
+  }
+  return ( long )ulKept;
+}
+
+bool sim_pcap_open_write(sim_pcap_t *pxPcap, const char *pcPath)
+{
+  pcap_file_header_t xHeader = { PCAP_MAGIC, 2, 4, 0, 0, SIM_PCAP_SNAPLEN, LINKTYPE_ETHERNET };
+
+  memset( pxPcap, 0, sizeof( *pxPcap ) );
+  pxPcap->pxFile = fopen( pcPath, "wb" );
+  if( pxPcap->pxFile == NULL )
+  {
+    return false;
+  }
+  if( fwrite( &xHeader, sizeof( xHeader ), 1, pxPcap->pxFile ) != 1 )
+  {
+    sim_pcap_close( pxPcap );
+    return false;
+  }
+  return true;
+}
+
+bool sim_pcap_write(sim_pcap_t *pxPcap, const void *pvFrame, unsigned long ulLength, unsigned long long ullTime)
+{
+  pcap_record_header_t xRecord;
+
+  xRecord.ts_sec = ( uint32_t )( ullTime / 1000000 );
+  xRecord.ts_frac = ( uint32_t )( ullTime % 1000000 );
+  xRecord.caplen = ( uint32_t )ulLength;
+  xRecord.len = ( uint32_t )ulLength;
+  return ( fwrite( &xRecord, sizeof( xRecord ), 1, pxPcap->pxFile ) == 1 )
+      && ( fwrite( pvFrame, 1, ulLength, pxPcap->pxFile ) == ulLength );
+}
+
+void sim_pcap_close(sim_pcap_t *pxPcap)
+{
+  if( pxPcap->pxFile != NULL )
+  {
+    fclose( pxPcap->pxFile );
+    pxPcap->pxFile = NULL;
+  }
+}
@@ -0,0 +1,39 @@
+/*
+ * pcap.h
+ *
+ * Classic libpcap capture files (LINKTYPE_ETHERNET), read and written without
+ * libpcap.
+ */
+
+#ifndef _SIM_PCAP_H_
+#define _SIM_PCAP_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SIM_PCAP_SNAPLEN    2048
+
+typedef struct
+{
+  FILE *pxFile;
+  bool xSwapped;      /* File written with the other byte order. */
+  bool xNano;         /* Timestamps in ns instead of us. */
+} sim_pcap_t;
+
+/* Open a capture to read, false if missing or not an Ethernet capture. */
+extern bool sim_pcap_open_read(sim_pcap_t *pxPcap, const char *pcPath);
+
+/* Read the next frame, at most ulMax bytes of it. Returns its captured
+ * length, 0 at the end of the file, -1 on a malformed file. *pullTime is set
+ * to its timestamp in us. */
+extern long sim_pcap_read(sim_pcap_t *pxPcap, void *pvFrame, unsigned long ulMax, unsigned long long *pullTime);
+
+/* Create a capture. */
+extern bool sim_pcap_open_write(sim_pcap_t *pxPcap, const char *pcPath);
+
+/* Append a frame timestamped ullTime us. */
+extern bool sim_pcap_write(sim_pcap_t *pxPcap, const void *pvFrame, unsigned long ulLength, unsigned long long ullTime);
+
+extern void sim_pcap_close(sim_pcap_t *pxPcap);
+
+#endif /* _SIM_PCAP_H_ */
@@ -0,0 +1,177 @@
+/*
+ * pcapif.c
+ *
+ * lwIP netif on capture files, see pcapif.h.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "netif/etharp.h"
+#include "pcapif.h"
+
+#define IFNAME0 'p'
+#define IFNAME1 'c'
+
+static unsigned long long prvNs(void)
+{
+  struct timespec xTime;
+
+  clock_gettime( CLOCK_MONOTONIC, &xTime );
+  return ( unsigned long long )xTime.tv_sec * 1000000000ULL + xTime.tv_nsec;
+}
+
+//!
+//! \brief Read the next frame of the input capture, and its time.
+//!
+static void prvReadNext(pcapif_t *pxIf)
+{
+  unsigned long long ullTime;
+
+  pxIf->lNextLength = pxIf->xInOpen
+                    ? sim_pcap_read( &pxIf->xIn, pxIf->ucNext, sizeof( pxIf->ucNext ), &ullTime )
+                    : 0;
+  if( pxIf->lNextLength <= 0 )
+  {
+    // End of the capture, or a malformed one.
+    pxIf->lNextLength = 0;
+    return;
+  }
+  if( !pxIf->xStarted )
+  {
+    pxIf->ullFirstUs = ullTime;
+    pxIf->xStarted = true;
+  }
+  pxIf->ulNextTime = ( ullTime > pxIf->ullFirstUs ) ? ( uint32_t )( ( ullTime - pxIf->ullFirstUs ) / 1000 ) : 0;
+  if( pxIf->ulNextTime < pxIf->ulNow )
+  {
+    // Out of order in the capture: pass it at once.
+    pxIf->ulNextTime = pxIf->ulNow;
+  }
+}
+
+bool pcapif_open(pcapif_t *pxIf, const char *pcIn, const char *pcOut, const char *pcRecord)
+{
+  memset( pxIf, 0, sizeof( *pxIf ) );
+  if( ( ( pcIn != NULL ) && !( pxIf->xInOpen = sim_pcap_open_read( &pxIf->xIn, pcIn ) ) )
+   || ( ( pcOut != NULL ) && !( pxIf->xOutOpen = sim_pcap_open_write( &pxIf->xOut, pcOut ) ) )
+   || ( ( pcRecord != NULL ) && !( pxIf->xRecordOpen = sim_pcap_open_write( &pxIf->xRecord, pcRecord ) ) ) )
+  {
+    pcapif_close( pxIf );
+    return false;
+  }
+  prvReadNext( pxIf );
+  return true;
+}
+
+void pcapif_close(pcapif_t *pxIf)
+{
+  if( pxIf->xInOpen )
+  {
+    sim_pcap_close( &pxIf->xIn );
+  }
+  if( pxIf->xOutOpen )
+  {
+    sim_pcap_close( &pxIf->xOut );
+  }
+  if( pxIf->xRecordOpen )
+  {
+    sim_pcap_close( &pxIf->xRecord );
+  }
+  pxIf->xInOpen = pxIf->xOutOpen = pxIf->xRecordOpen = false;
+  pxIf->lNextLength = 0;
+}
+
+void pcapif_set_tx_handler(pcapif_t *pxIf, pcapif_tx_fn pxTx, void *pvArg)
+{
+  pxIf->pxTx = pxTx;
+  pxIf->pvTxArg = pvArg;
+}
+
+//!
+//! \brief netif->linkoutput: write the frame to the output capture.
+//!
+static err_t prvOutput(struct netif *netif, struct pbuf *p)
+{
+  static unsigned char ucFrame[ SIM_PCAP_SNAPLEN ];
+  pcapif_t *pxIf = ( pcapif_t * )netif->state;
+  u16_t usLength;
+
+  usLength = pbuf_copy_partial( p, ucFrame, sizeof( ucFrame ), 0 );
+  pxIf->xStats.ulTxFrames++;
+  if( pxIf->xOutOpen )
+  {
+    sim_pcap_write( &pxIf->xOut, ucFrame, usLength, ( unsigned long long )pxIf->ulNow * 1000 );
+  }
+  if( pxIf->pxTx != NULL )
+  {
+    pxIf->pxTx( ucFrame, usLength, pxIf->ulNow, pxIf->pvTxArg );
+  }
+  LINK_STATS_INC(link.xmit);
+  return ERR_OK;
+}
+
+err_t pcapif_init(struct netif *netif)
+{
+  netif->name[ 0 ] = IFNAME0;
+  netif->name[ 1 ] = IFNAME1;
+  netif->output = etharp_output;
+  netif->linkoutput = prvOutput;
+  netif->mtu = 1500;
+  netif->hwaddr_len = ETHARP_HWADDR_LEN;
+  netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+  return ERR_OK;
+}
+
+void pcapif_inject(struct netif *netif, const void *pvFrame, unsigned long ulLength)
+{
+  pcapif_t *pxIf = ( pcapif_t * )netif->state;
+  unsigned long long ullStart, ullNs;
+  struct pbuf *p;
+
+  if( pxIf->xRecordOpen )
+  {
+    sim_pcap_write( &pxIf->xRecord, pvFrame, ulLength, ( unsigned long long )pxIf->ulNow * 1000 );
+  }
+
+  p = pbuf_alloc( PBUF_RAW, ( u16_t )ulLength, PBUF_POOL );
+  if( p == NULL )
+  {
+    pxIf->xStats.ulRxDropped++;
+    LINK_STATS_INC(link.memerr);
+    LINK_STATS_INC(link.drop);
+    return;
+  }
+  pbuf_take( p, pvFrame, ( u16_t )ulLength );
+  LINK_STATS_INC(link.recv);
+
+  ullStart = prvNs();
+  if( netif->input( p, netif ) != ERR_OK )
+  {
+    pbuf_free( p );
+  }
+  ullNs = prvNs() - ullStart;
+
+  pxIf->xStats.ulRxFrames++;
+  pxIf->xStats.ullRxNs += ullNs;
+  if( ullNs > pxIf->xStats.ullRxMaxNs )
+  {
+    pxIf->xStats.ullRxMaxNs = ullNs;
+  }
+}
+
+uint32_t pcapif_poll(struct netif *netif, uint32_t ulNow)
+{
+  pcapif_t *pxIf = ( pcapif_t * )netif->state;
+
+  pxIf->ulNow = ulNow;
+  while( ( pxIf->lNextLength != 0 ) && ( pxIf->ulNextTime <= ulNow ) )
+  {
+    pcapif_inject( netif, pxIf->ucNext, pxIf->lNextLength );
+    prvReadNext( pxIf );
+  }
+  return ( pxIf->lNextLength != 0 ) ? pxIf->ulNextTime - ulNow : PCAPIF_NONE;
+}
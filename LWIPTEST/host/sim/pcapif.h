@@ -0,0 +1,69 @@
+/*
+ * pcapif.h
+ *
+ * lwIP netif on capture files: the frames of an input capture are passed to
+ * netif->input (ethernet_input()) at their time on the virtual clock, and the
+ * frames lwIP sends are written to an output capture, timestamped with the
+ * virtual clock. Frames can also be injected one by one, for a peer scripted
+ * by a test. Time is in ms, from the first frame of the input capture.
+ */
+
+#ifndef _SIM_PCAPIF_H_
+#define _SIM_PCAPIF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/netif.h"
+#include "pcap.h"
+
+/* Returned by pcapif_poll() when the input capture is exhausted. */
+#define PCAPIF_NONE         UINT32_MAX
+
+/* Frame sent by lwIP, time in ms on the virtual clock. */
+typedef void (*pcapif_tx_fn)(const unsigned char *pucFrame, unsigned long ulLength, uint32_t ulTime, void *pvArg);
+
+typedef struct
+{
+  unsigned long ulRxFrames;       /* Frames passed to netif->input. */
+  unsigned long ulTxFrames;       /* Frames sent by lwIP. */
+  unsigned long ulRxDropped;      /* Frames lost for lack of pbufs. */
+  unsigned long long ullRxNs;     /* Time spent in netif->input. */
+  unsigned long long ullRxMaxNs;  /* Longest netif->input call. */
+} pcapif_stats_t;
+
+/* Passed to netif_add() as the netif state. */
+typedef struct
+{
+  sim_pcap_t xIn, xOut, xRecord;
+  bool xInOpen, xOutOpen, xRecordOpen;
+  bool xStarted;                  /* ullFirstUs is set. */
+  unsigned char ucNext[ SIM_PCAP_SNAPLEN ];
+  long lNextLength;               /* 0 once the input capture is exhausted. */
+  unsigned long long ullFirstUs;  /* Timestamp of the first input frame. */
+  uint32_t ulNextTime;
+  uint32_t ulNow;                 /* Virtual clock, set by pcapif_poll(). */
+  pcapif_tx_fn pxTx;
+  void *pvTxArg;
+  pcapif_stats_t xStats;
+} pcapif_t;
+
+/* Set up a pcapif_t, with an input capture, an output capture and a capture
+ * of the frames received (for a scripted peer), each optional (NULL). */
+extern bool pcapif_open(pcapif_t *pxIf, const char *pcIn, const char *pcOut, const char *pcRecord);
+extern void pcapif_close(pcapif_t *pxIf);
+
+/* Also pass the frames sent to pxTx. */
+extern void pcapif_set_tx_handler(pcapif_t *pxIf, pcapif_tx_fn pxTx, void *pvArg);
+
+/* netif init function, for netif_add(). */
+extern err_t pcapif_init(struct netif *netif);
+
+/* Set the virtual clock and pass the input frames due by then to lwIP.
+ * Returns the time until the next input frame, or PCAPIF_NONE. */
+extern uint32_t pcapif_poll(struct netif *netif, uint32_t ulNow);
+
+/* Pass a frame to lwIP now. */
+extern void pcapif_inject(struct netif *netif, const void *pvFrame, unsigned long ulLength);
+
+#endif /* _SIM_PCAPIF_H_ */
@@ -0,0 +1,20 @@
+/*
+ * sim_board.h
+ *
+ * Host stand-ins for the interrupt controller, GPIO and EIC drivers.
+ */
+
+#ifndef _SIM_BOARD_H_
+#define _SIM_BOARD_H_
+
+#include "compiler.h"
+#include "intc.h"
+
+/* Handler registered for an interrupt line by INTC_register_interrupt(),
+ * NULL if none. */
+extern __int_handler sim_intc_handler(uint32_t irq);
+
+/* Forget the handlers registered. */
+extern void sim_intc_reset(void);
+
+#endif /* _SIM_BOARD_H_ */
@@ -0,0 +1,426 @@
+/*
+ * sim_macb.c
+ *
+ * Simulated MACB, see sim_macb.h.
+ *
+ * The DMA engines follow the descriptor formats of macb.h: an Rx buffer
+ * belongs to the MACB while bit 0 of its address is clear, a Tx buffer while
+ * AVR32_TRANSMIT_OK is clear. Frames are received in MACB_RX_BUFFER_SIZE
+ * chunks, the first buffer marked AVR32_SOF and the last one AVR32_EOF with
+ * the frame length. A sent frame is marked by setting AVR32_TRANSMIT_OK in
+ * its first descriptor only. Both engines go back to the start of their queue
+ * on a descriptor with the wrap bit, and the transmitter goes back there
+ * after a Tx error.
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "macb.h"
+#include "pcap.h"
+#include "sim_board.h"
+#include "sim_macb.h"
+
+/* Wrap bit of the Rx descriptor address. */
+#define SIM_RX_WRAP                 0x00000002
+
+/* Length of the data of a Tx buffer. */
+#define SIM_TX_LENGTH               0x000007FF
+
+/* Largest frame accepted (NCFGR.BIG not set), FCS removed. */
+#define SIM_RX_MAX_FRAME            1518
+
+/* Largest frame sent. */
+#define SIM_TX_MAX_FRAME            2048
+
+/* Calls to macbTX_BUFFER_WAIT() without any frame sent after which the driver
+is considered stuck. */
+#define SIM_TX_MAX_WAITS            100000
+
+avr32_macb_t AVR32_MACB;
+
+sim_macb_stats_t sim_macb_stats;
+
+/* Start of the queues, as last written to RBQP and TBQP, and descriptors the
+DMA engines use next. */
+static volatile AVR32_RxTdDescriptor *pxRxStart, *pxRxCurrent;
+static volatile AVR32_TxTdDescriptor *pxTxStart, *pxTxCurrent;
+
+/* The transmitter was started with NCR.TSTART and has not read a used
+descriptor since. */
+static bool xTxGo;
+
+/* Back-pressure, see sim_macb_tx_pause(). */
+static unsigned long ulTxPauseWaits;
+
+/* Error to raise on the next frame sent, see sim_macb_tx_fail_next(). */
+static unsigned long ulTxFailBit;
+
+/* Calls to macbTX_BUFFER_WAIT() since the last frame sent. */
+static unsigned long ulTxStuckWaits;
+
+static sim_tx_handler_t pxTxHandler;
+static void *pvTxArg;
+static sim_pcap_t xTxCapture;
+
+
+//!
+//! \brief Act on the registers written by the driver since the last call.
+//!
+static void prvSync(void)
+{
+  if( AVR32_MACB.idr )
+  {
+    AVR32_MACB.imr &= ~AVR32_MACB.idr;
+    AVR32_MACB.idr = 0;
+  }
+  if( AVR32_MACB.ier )
+  {
+    AVR32_MACB.imr |= AVR32_MACB.ier;
+    AVR32_MACB.ier = 0;
+  }
+
+  if( AVR32_MACB.rbqp )
+  {
+    pxRxStart = pxRxCurrent = ( volatile AVR32_RxTdDescriptor * )( uintptr_t )AVR32_MACB.rbqp;
+    AVR32_MACB.rbqp = 0;
+  }
+  if( AVR32_MACB.tbqp )
+  {
+    pxTxStart = pxTxCurrent = ( volatile AVR32_TxTdDescriptor * )( uintptr_t )AVR32_MACB.tbqp;
+    AVR32_MACB.tbqp = 0;
+  }
+
+  if( !( AVR32_MACB.ncr & AVR32_MACB_NCR_TE_MASK ) )
+  {
+    // Disabling the transmitter resets it to the start of the queue.
+    xTxGo = false;
+    pxTxCurrent = pxTxStart;
+  }
+  else if( AVR32_MACB.ncr & AVR32_MACB_TSTART_MASK )
+  {
+    xTxGo = ( pxTxCurrent != NULL );
+  }
+  AVR32_MACB.ncr &= ~AVR32_MACB_TSTART_MASK;
+
+  // The management frames complete at once.
+  AVR32_MACB.nsr |= AVR32_MACB_NSR_IDLE_MASK;
+}
+
+//!
+//! \brief Call vMACB_ISR() if an unmasked interrupt is pending.
+//!
+static void prvIrq(void)
+{
+  __int_handler pxHandler = sim_intc_handler( AVR32_MACB_IRQ );
+
+  prvSync();
+  if( ( pxHandler != NULL ) && ( AVR32_MACB.isr & AVR32_MACB.imr ) )
+  {
+    sim_macb_stats.ulIrqs++;
+    pxHandler();
+    // The handler has read ISR, which clears it.
+    AVR32_MACB.isr = 0;
+    prvSync();
+  }
+}
+
+//!
+//! \brief Address filter: our address, broadcast unless NCFGR.NBC, multicast
+//! addresses matching the hash filter if NCFGR.MTI.
+//!
+static bool prvRxAccept(const unsigned char *pucFrame)
+{
+  unsigned long ulBit, ulIndex = 0;
+
+  if( pucFrame[ 0 ] & 0x01 )
+  {
+    if( memcmp( pucFrame, "\xff\xff\xff\xff\xff\xff", 6 ) == 0 )
+    {
+      return !( AVR32_MACB.ncfgr & AVR32_MACB_NCFGR_NBC_MASK );
+    }
+    if( !( AVR32_MACB.ncfgr & AVR32_MACB_NCFGR_MTI_MASK ) )
+    {
+      return false;
+    }
+    for( ulBit = 0; ulBit < 48; ulBit++ )
+    {
+      if( pucFrame[ ulBit / 8 ] & ( 1 << ( ulBit % 8 ) ) )
+      {
+        ulIndex ^= 1 << ( ulBit % 6 );
+      }
+    }
+    return ( ulIndex < 32 ) ? ( ( AVR32_MACB.hrb >> ulIndex ) & 1 )
+                            : ( ( AVR32_MACB.hrt >> ( ulIndex - 32 ) ) & 1 );
+  }
+
+  return ( pucFrame[ 0 ] == ( ( AVR32_MACB.sa1b >> 0 ) & 0xff ) )
+      && ( pucFrame[ 1 ] == ( ( AVR32_MACB.sa1b >> 8 ) & 0xff ) )
+      && ( pucFrame[ 2 ] == ( ( AVR32_MACB.sa1b >> 16 ) & 0xff ) )
+      && ( pucFrame[ 3 ] == ( ( AVR32_MACB.sa1b >> 24 ) & 0xff ) )
+      && ( pucFrame[ 4 ] == ( ( AVR32_MACB.sa1t >> 0 ) & 0xff ) )
+      && ( pucFrame[ 5 ] == ( ( AVR32_MACB.sa1t >> 8 ) & 0xff ) );
+}
+
+//!
+//! \brief Write a frame to the Rx buffers, only its first ulBuffers buffers
+//! and without the end of frame if xComplete is false.
+//!
+static sim_rx_result_t prvRxWrite(const unsigned char *pucFrame, unsigned long ulLength,
+                                  unsigned long ulBuffers, bool xComplete)
+{
+  volatile AVR32_RxTdDescriptor *pxDesc;
+  unsigned long ulOffset = 0, ulChunk, ulStatus, ulBuffer;
+
+  prvSync();
+  if( !( AVR32_MACB.ncr & AVR32_MACB_NCR_RE_MASK ) || ( pxRxCurrent == NULL ) )
+  {
+    return SIM_RX_DISABLED;
+  }
+  if( ( ulLength < 14 ) || ( ulLength > SIM_RX_MAX_FRAME ) || !prvRxAccept( pucFrame ) )
+  {
+    sim_macb_stats.ulRxFiltered++;
+    return SIM_RX_FILTERED;
+  }
+
+  for( ulBuffer = 0; ( ulOffset < ulLength ) && ( ulBuffer < ulBuffers ); ulBuffer++ )
+  {
+    pxDesc = pxRxCurrent;
+    if( pxDesc->addr & AVR32_OWNERSHIP_BIT )
+    {
+      // The buffers already written keep the start of the frame.
+      AVR32_MACB.rsr |= AVR32_MACB_RSR_BNA_MASK;
+      AVR32_MACB.isr |= SIM_MACB_ISR_RXUBR;
+      sim_macb_stats.ulRxBna++;
+      prvIrq();
+      return SIM_RX_BNA;
+    }
+
+    ulChunk = ulLength - ulOffset;
+    if( ulChunk > MACB_RX_BUFFER_SIZE )
+    {
+      ulChunk = MACB_RX_BUFFER_SIZE;
+    }
+    memcpy( ( void * )( uintptr_t )( pxDesc->addr & ~3UL ), &pucFrame[ ulOffset ], ulChunk );
+    ulOffset += ulChunk;
+
+    ulStatus = ( ulBuffer == 0 ) ? AVR32_SOF : 0;
+    if( xComplete && ( ulOffset == ulLength ) )
+    {
+      ulStatus |= AVR32_EOF | ulLength;
+    }
+    pxDesc->U_Status.status = ulStatus;
+    pxDesc->addr |= AVR32_OWNERSHIP_BIT;
+
+    pxRxCurrent = ( pxDesc->addr & SIM_RX_WRAP ) ? pxRxStart : pxDesc + 1;
+  }
+
+  if( xComplete )
+  {
+    AVR32_MACB.rsr |= AVR32_MACB_REC_MASK;
+    AVR32_MACB.isr |= AVR32_MACB_IER_RCOMP_MASK;
+    sim_macb_stats.ulRxFrames++;
+    prvIrq();
+  }
+  return SIM_RX_OK;
+}
+
+//!
+//! \brief Send the frames queued, up to the first used descriptor.
+//!
+static unsigned long prvTxRun(void)
+{
+  static unsigned char ucFrame[ SIM_TX_MAX_FRAME ];
+  volatile AVR32_TxTdDescriptor *pxFirst, *pxDesc, *pxNext;
+  unsigned long ulStatus, ulLength, ulChunk, ulError, ulSent = 0;
+
+  prvSync();
+  while( xTxGo && ( ulTxPauseWaits == 0 ) )
+  {
+    pxFirst = pxTxCurrent;
+    if( pxFirst->U_Status.status & AVR32_TRANSMIT_OK )
+    {
+      // Nothing left to send.
+      AVR32_MACB.isr |= SIM_MACB_ISR_TXUBR;
+      xTxGo = false;
+      break;
+    }
+
+    // Gather the frame, a used descriptor before its last buffer being an
+    // underrun.
+    ulError = ulTxFailBit;
+    ulTxFailBit = 0;
+    ulLength = 0;
+    for( pxDesc = pxFirst; ; pxDesc = pxNext )
+    {
+      ulStatus = pxDesc->U_Status.status;
+      if( ( pxDesc != pxFirst ) && ( ulStatus & AVR32_TRANSMIT_OK ) )
+      {
+        ulError = AVR32_MACB_ISR_TUND_MASK;
+        break;
+      }
+      ulChunk = ulStatus & SIM_TX_LENGTH;
+      if( ulLength + ulChunk > sizeof( ucFrame ) )
+      {
+        fprintf( stderr, "sim_macb: Tx frame longer than %u bytes\n", ( unsigned )sizeof( ucFrame ) );
+        abort();
+      }
+      memcpy( &ucFrame[ ulLength ], ( const void * )( uintptr_t )pxDesc->addr, ulChunk );
+      ulLength += ulChunk;
+      pxNext = ( ulStatus & AVR32_TRANSMIT_WRAP ) ? pxTxStart : pxDesc + 1;
+      if( ulStatus & AVR32_LAST_BUFFER )
+      {
+        break;
+      }
+    }
+
+    if( ulError )
+    {
+      // The transmitter stops and goes back to the start of the queue.
+      AVR32_MACB.tsr |= ( ulError == AVR32_MACB_ISR_TUND_MASK ) ? AVR32_MACB_TSR_UND_MASK
+                                                                : AVR32_MACB_TSR_RLE_MASK;
+      AVR32_MACB.isr |= ulError;
+      pxTxCurrent = pxTxStart;
+      xTxGo = false;
+      sim_macb_stats.ulTxErrors++;
+      break;
+    }
+
+    pxFirst->U_Status.status |= AVR32_TRANSMIT_OK;
+    pxTxCurrent = pxNext;
+    AVR32_MACB.tsr |= AVR32_MACB_TSR_COMP_MASK;
+    AVR32_MACB.isr |= AVR32_MACB_TCOMP_MASK;
+    sim_macb_stats.ulTxFrames++;
+    ulSent++;
+
+    if( xTxCapture.pxFile != NULL )
+    {
+      sim_pcap_write( &xTxCapture, ucFrame, ulLength, sim_macb_stats.ulTxFrames * 1000ULL );
+    }
+    if( pxTxHandler != NULL )
+    {
+      pxTxHandler( ucFrame, ulLength, pvTxArg );
+    }
+  }
+  return ulSent;
+}
+
+void sim_macb_reset(void)
+{
+  // The descriptors hold 32-bit addresses: keep the heap contiguous, and
+  // check that it is low enough.
+  mallopt( M_MMAP_MAX, 0 );
+  if( ( ( uintptr_t )&AVR32_MACB >> 32 ) || ( ( uintptr_t )sbrk( 0 ) >> 32 ) )
+  {
+    fprintf( stderr, "sim_macb: data above 4 GB, link with -no-pie\n" );
+    abort();
+  }
+
+  memset( ( void * )&AVR32_MACB, 0, sizeof( AVR32_MACB ) );
+  AVR32_MACB.nsr = AVR32_MACB_NSR_IDLE_MASK;
+  memset( &sim_macb_stats, 0, sizeof( sim_macb_stats ) );
+  pxRxStart = pxRxCurrent = NULL;
+  pxTxStart = pxTxCurrent = NULL;
+  xTxGo = false;
+  ulTxPauseWaits = 0;
+  ulTxFailBit = 0;
+  ulTxStuckWaits = 0;
+  sim_intc_reset();
+}
+
+void sim_macb_set_tx_handler(sim_tx_handler_t pxHandler, void *pvArg)
+{
+  pxTxHandler = pxHandler;
+  pvTxArg = pvArg;
+}
+
+bool sim_macb_tx_capture(const char *pcPath)
+{
+  sim_pcap_close( &xTxCapture );
+  return ( pcPath == NULL ) || sim_pcap_open_write( &xTxCapture, pcPath );
+}
+
+sim_rx_result_t sim_macb_rx_frame(const void *pvFrame, unsigned long ulLength)
+{
+  return prvRxWrite( pvFrame, ulLength, ~0UL, true );
+}
+
+sim_rx_result_t sim_macb_rx_truncated(const void *pvFrame, unsigned long ulLength, unsigned long ulBuffers)
+{
+  return prvRxWrite( pvFrame, ulLength, ulBuffers, false );
+}
+
+long sim_macb_rx_pcap(const char *pcPath)
+{
+  static unsigned char ucFrame[ SIM_PCAP_SNAPLEN ];
+  sim_pcap_t xPcap;
+  long lLength, lReceived = 0;
+
+  if( !sim_pcap_open_read( &xPcap, pcPath ) )
+  {
+    return -1;
+  }
+  while( ( lLength = sim_pcap_read( &xPcap, ucFrame, sizeof( ucFrame ), NULL ) ) > 0 )
+  {
+    if( sim_macb_rx_frame( ucFrame, lLength ) == SIM_RX_OK )
+    {
+      lReceived++;
+    }
+  }
+  sim_pcap_close( &xPcap );
+  return ( lLength < 0 ) ? -1 : lReceived;
+}
+
+unsigned long sim_macb_poll(void)
+{
+  unsigned long ulSent, ulTotal = 0;
+
+  do
+  {
+    ulSent = prvTxRun();
+    ulTotal += ulSent;
+    // The ISR restarts the transmitter after an error.
+    prvIrq();
+  } while( ulSent || ( xTxGo && ( ulTxPauseWaits == 0 ) ) );
+
+  if( ulTotal )
+  {
+    ulTxStuckWaits = 0;
+  }
+  return ulTotal;
+}
+
+void sim_macb_tx_pause(unsigned long ulWaits)
+{
+  ulTxPauseWaits = ulWaits;
+}
+
+void sim_macb_tx_fail_next(unsigned long ulIsrBit)
+{
+  ulTxFailBit = ulIsrBit;
+}
+
+void sim_macb_tx_wait(void)
+{
+  sim_macb_stats.ulTxWaits++;
+  if( ulTxPauseWaits )
+  {
+    ulTxPauseWaits--;
+  }
+  if( ++ulTxStuckWaits > SIM_TX_MAX_WAITS )
+  {
+    fprintf( stderr, "sim_macb: no Tx buffer freed after %u waits\n", SIM_TX_MAX_WAITS );
+    abort();
+  }
+  sim_macb_poll();
+}
+
+void sim_macb_clear_status(volatile unsigned long *pulReg, unsigned long ulMask)
+{
+  *pulReg &= ~ulMask;
+}
@@ -0,0 +1,88 @@
+/*
+ * sim_macb.h
+ *
+ * Simulated MACB for the host build: register block, Rx and Tx DMA engines
+ * working on the driver descriptors, and interrupt delivery to vMACB_ISR().
+ *
+ * Registers are plain memory, so the simulation acts on what the driver
+ * wrote each time one of the functions below is called:
+ * - NCR.TSTART, IER, IDR, RBQP and TBQP are write strobes, consumed (reset
+ *   to 0) by the simulation. Writing RBQP or TBQP sets the start of the
+ *   queue: the DMA goes back there on a descriptor with the wrap bit.
+ * - RSR and TSR are write-one-to-clear, through macbCLEAR_STATUS().
+ * - ISR is cleared once vMACB_ISR() has run.
+ * - NSR always reads idle, MAN reads back what was written: the PHY answers
+ *   0 to every read.
+ */
+
+#ifndef _SIM_MACB_H_
+#define _SIM_MACB_H_
+
+#include <stdbool.h>
+#include <avr32/io.h>
+
+/* Interrupt status bits not used by the driver. */
+#define SIM_MACB_ISR_RXUBR          0x00000004
+#define SIM_MACB_ISR_TXUBR          0x00000008
+
+/* Result of sim_macb_rx_frame(). */
+typedef enum
+{
+  SIM_RX_OK,          /* Frame written to the Rx buffers. */
+  SIM_RX_FILTERED,    /* Dropped by the address filter. */
+  SIM_RX_DISABLED,    /* Dropped, NCR.RE is not set. */
+  SIM_RX_BNA          /* Dropped on a buffer owned by the driver. */
+} sim_rx_result_t;
+
+/* Frame handed over by the Tx DMA. */
+typedef void (*sim_tx_handler_t)(const unsigned char *pucFrame, unsigned long ulLength, void *pvArg);
+
+typedef struct
+{
+  unsigned long ulRxFrames;       /* Frames written to the Rx buffers. */
+  unsigned long ulRxFiltered;     /* Frames dropped by the address filter. */
+  unsigned long ulRxBna;          /* Frames dropped on a driver buffer. */
+  unsigned long ulTxFrames;       /* Frames sent. */
+  unsigned long ulTxErrors;       /* Frames aborted by sim_macb_tx_fail_next(). */
+  unsigned long ulTxWaits;        /* Calls to macbTX_BUFFER_WAIT(). */
+  unsigned long ulIrqs;           /* Calls to vMACB_ISR(). */
+} sim_macb_stats_t;
+
+extern sim_macb_stats_t sim_macb_stats;
+
+/* Power-on state: registers cleared, DMA stopped, statistics reset. */
+extern void sim_macb_reset(void);
+
+/* Frames sent are passed to pxHandler, and written to the capture file set by
+ * sim_macb_tx_capture() if any. */
+extern void sim_macb_set_tx_handler(sim_tx_handler_t pxHandler, void *pvArg);
+extern bool sim_macb_tx_capture(const char *pcPath);
+
+/* Receive a frame (without FCS) as the MACB would, through the address
+ * filter, then interrupt. */
+extern sim_rx_result_t sim_macb_rx_frame(const void *pvFrame, unsigned long ulLength);
+
+/* Receive only the first ulBuffers buffers of a frame, as when reception is
+ * aborted: the buffers have SOF but no EOF. */
+extern sim_rx_result_t sim_macb_rx_truncated(const void *pvFrame, unsigned long ulLength, unsigned long ulBuffers);
+
+/* Receive every frame of a pcap file, returns the number received or -1. */
+extern long sim_macb_rx_pcap(const char *pcPath);
+
+/* Run the Tx DMA until it has nothing left to send, and deliver the
+ * interrupts. Returns the number of frames sent. */
+extern unsigned long sim_macb_poll(void);
+
+/* Back-pressure: the transmitter sends nothing until the driver has waited
+ * ulWaits times for a Tx buffer. */
+extern void sim_macb_tx_pause(unsigned long ulWaits);
+
+/* Abort the next frame sent with an underrun (AVR32_MACB_ISR_TUND_MASK) or
+ * a retry limit error (AVR32_MACB_ISR_RLE_MASK). */
+extern void sim_macb_tx_fail_next(unsigned long ulIsrBit);
+
+/* macbTX_BUFFER_WAIT() and macbCLEAR_STATUS() of the host build. */
+extern void sim_macb_tx_wait(void);
+extern void sim_macb_clear_status(volatile unsigned long *pulReg, unsigned long ulMask);
+
+#endif /* _SIM_MACB_H_ */
@@ -0,0 +1,144 @@
+/*
+ * stack.c
+ *
+ * The board network stack on a pcapif, see stack.h.
+ */
+
+#include <string.h>
+
+#include "conf_eth.h"
+#include "lwip/init.h"
+#include "lwip/ip_frag.h"
+#include "lwip/sys.h"
+#include "lwip/tcp_impl.h"
+#include "netif/etharp.h"
+#include "httpd.h"
+#include "COMM_server.h"
+#include "timer_wheel.h"
+#include "stack.h"
+
+struct netif stack_netif;
+
+static pcapif_t *pxStackIf;
+static uint32_t ulNow = 0;
+
+/* lwIP periodic timers, as registered by ethernet.c on the board */
+static wheel_timer_t xEtharpTimer, xTcpTimer;
+#if IP_REASSEMBLY
+static wheel_timer_t xIpReassTimer;
+#endif
+
+static void prvEtharpTimer(void *pvArg)
+{
+  etharp_tmr();
+}
+
+static void prvTcpTimer(void *pvArg)
+{
+  tcp_tmr();
+}
+
+#if IP_REASSEMBLY
+static void prvIpReassTimer(void *pvArg)
+{
+  ip_reass_tmr();
+}
+#endif
+
+u32_t sys_now(void)
+{
+  return ulNow;
+}
+
+uint32_t stack_now(void)
+{
+  return ulNow;
+}
+
+void stack_init(pcapif_t *pxIf)
+{
+  ip_addr_t xIp, xMask, xGateway;
+
+  pxStackIf = pxIf;
+  ulNow = 0;
+  lwip_init();
+
+  IP4_ADDR( &xIp, ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, ETHERNET_CONF_IPADDR3 );
+  IP4_ADDR( &xMask, ETHERNET_CONF_NET_MASK0, ETHERNET_CONF_NET_MASK1, ETHERNET_CONF_NET_MASK2, ETHERNET_CONF_NET_MASK3 );
+  IP4_ADDR( &xGateway, ETHERNET_CONF_GATEWAY_ADDR0, ETHERNET_CONF_GATEWAY_ADDR1, ETHERNET_CONF_GATEWAY_ADDR2, ETHERNET_CONF_GATEWAY_ADDR3 );
+  netif_add( &stack_netif, &xIp, &xMask, &xGateway, pxIf, pcapif_init, ethernet_input );
+  stack_netif.hwaddr[ 0 ] = ETHERNET_CONF_ETHADDR0;
+  stack_netif.hwaddr[ 1 ] = ETHERNET_CONF_ETHADDR1;
+  stack_netif.hwaddr[ 2 ] = ETHERNET_CONF_ETHADDR2;
+  stack_netif.hwaddr[ 3 ] = ETHERNET_CONF_ETHADDR3;
+  stack_netif.hwaddr[ 4 ] = ETHERNET_CONF_ETHADDR4;
+  stack_netif.hwaddr[ 5 ] = ETHERNET_CONF_ETHADDR5;
+  netif_set_default( &stack_netif );
+  netif_set_up( &stack_netif );
+
+  timer_wheel_init( ulNow );
+  timer_wheel_add( &xEtharpTimer, ARP_TMR_INTERVAL, ARP_TMR_INTERVAL, prvEtharpTimer, NULL );
+  timer_wheel_add( &xTcpTimer, TCP_TMR_INTERVAL, TCP_TMR_INTERVAL, prvTcpTimer, NULL );
+#if IP_REASSEMBLY
+  timer_wheel_add( &xIpReassTimer, IP_TMR_INTERVAL, IP_TMR_INTERVAL, prvIpReassTimer, NULL );
+#endif
+
+  httpd_init();
+  COMM_server_start();
+}
+
+//!
+//! \brief Stand-in for the application: echo what the COMM_server client
+//! sends.
+//!
+static void prvApplication(void)
+{
+  unsigned char ucBuffer[ 256 ];
+  int lLength;
+
+  while( ( lLength = COMM_server_read( ucBuffer, sizeof( ucBuffer ) ) ) > 0 )
+  {
+    COMM_server_write( ucBuffer, lLength );
+  }
+}
+
+void stack_run_until(uint32_t ulTime)
+{
+  uint32_t ulNext, ulFrame;
+
+  if( ulTime < ulNow )
+  {
+    ulTime = ulNow;
+  }
+  for( ;; )
+  {
+    // One pass of the board main loop at ulNow.
+    ulNext = timer_wheel_run( ulNow );
+    ulFrame = pcapif_poll( &stack_netif, ulNow );
+    prvApplication();
+    netif_poll_all();
+
+    if( ulNow == ulTime )
+    {
+      break;
+    }
+    if( ulFrame < ulNext )
+    {
+      ulNext = ulFrame;
+    }
+    if( ulNext == 0 )
+    {
+      ulNext = 1;
+    }
+    ulNow = ( ulNext >= ulTime - ulNow ) ? ulTime : ulNow + ulNext;
+  }
+}
+
+void stack_replay(uint32_t ulDrain)
+{
+  while( pxStackIf->lNextLength != 0 )
+  {
+    stack_run_until( pxStackIf->ulNextTime );
+  }
+  stack_run_until( ulNow + ulDrain );
+}
@@ -0,0 +1,38 @@
+/*
+ * stack.h
+ *
+ * The board network stack on a pcapif, for the host: lwIP with the static
+ * address of conf_eth.h, its periodic timers on the timer wheel, httpd and
+ * COMM_server, all driven by a virtual clock in ms. The clock only moves
+ * forward from one event (input frame, timer deadline) to the next, so a
+ * capture replayed twice gives the same frames at the same times.
+ *
+ * The application behind COMM_server is stood in for by an echo: what a
+ * client sends is written back to it.
+ */
+
+#ifndef _SIM_STACK_H_
+#define _SIM_STACK_H_
+
+#include <stdint.h>
+
+#include "lwip/netif.h"
+#include "pcapif.h"
+
+extern struct netif stack_netif;
+
+/* Start lwIP on pxIf, the timers and the servers, at time 0. Once per
+ * process: lwIP cannot be restarted. */
+extern void stack_init(pcapif_t *pxIf);
+
+/* Virtual clock, in ms. Also lwIP's sys_now(). */
+extern uint32_t stack_now(void);
+
+/* Move the virtual clock up to ulTime, passing the input frames, firing the
+ * timers and running the application on the way. */
+extern void stack_run_until(uint32_t ulTime);
+
+/* Run until the input capture is exhausted, then ulDrain ms more. */
+extern void stack_replay(uint32_t ulDrain);
+
+#endif /* _SIM_STACK_H_ */
@@ -0,0 +1,84 @@
+/*
+ * stubs.c
+ *
+ * Host stand-ins for the peripherals and drivers the MACB driver uses besides
+ * the MACB itself: the handlers registered with the interrupt controller are
+ * kept for the simulation to call, pin and EIC setup does nothing.
+ */
+
+#include <string.h>
+
+#include "compiler.h"
+#include "gpio.h"
+#include "eic.h"
+#include "sim_board.h"
+
+avr32_gpio_t AVR32_GPIO;
+avr32_eic_t AVR32_EIC;
+
+#define SIM_INTC_NB_IRQS    128
+
+static __int_handler pxHandlers[ SIM_INTC_NB_IRQS ];
+
+void INTC_register_interrupt(__int_handler handler, uint32_t irq, uint32_t int_level)
+{
+  ( void )int_level;
+  if( irq < SIM_INTC_NB_IRQS )
+  {
+    pxHandlers[ irq ] = handler;
+  }
+}
+
+__int_handler sim_intc_handler(uint32_t irq)
+{
+  return ( irq < SIM_INTC_NB_IRQS ) ? pxHandlers[ irq ] : NULL;
+}
+
+void sim_intc_reset(void)
+{
+  memset( pxHandlers, 0, sizeof( pxHandlers ) );
+}
+
+uint32_t gpio_enable_module(const gpio_map_t gpiomap, uint32_t size)
+{
+  ( void )gpiomap;
+  ( void )size;
+  return GPIO_SUCCESS;
+}
+
+void gpio_enable_pin_pull_up(uint32_t pin)
+{
+  ( void )pin;
+}
+
+uint32_t gpio_enable_pin_interrupt(uint32_t pin, uint32_t mode)
+{
+  ( void )pin;
+  ( void )mode;
+  return GPIO_SUCCESS;
+}
+
+void eic_init(volatile avr32_eic_t *eic, const eic_options_t *opt, uint32_t nb_lines)
+{
+  ( void )eic;
+  ( void )opt;
+  ( void )nb_lines;
+}
+
+void eic_enable_line(volatile avr32_eic_t *eic, uint32_t line_number)
+{
+  ( void )eic;
+  ( void )line_number;
+}
+
+void eic_enable_interrupt_line(volatile avr32_eic_t *eic, uint32_t line_number)
+{
+  ( void )eic;
+  ( void )line_number;
+}
+
+void eic_clear_interrupt_line(volatile avr32_eic_t *eic, uint32_t line_number)
+{
+  ( void )eic;
+  ( void )line_number;
+}
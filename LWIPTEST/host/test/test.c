@@ -0,0 +1,59 @@
+/*
+ * test.c
+ *
+ * Minimal test runner, see test.h.
+ */
+
+#include <stdio.h>
+
+#include "test.h"
+
+unsigned long ulTestFailures;
+const char *pcTestDataDir = "test/data";
+const char *pcTestProgram = "test";
+
+int test_main(const test_case_t *pxTests, int argc, char **argv)
+{
+  unsigned long ulBefore, ulFailed = 0, ulRun = 0;
+
+  pcTestProgram = argv[ 0 ];
+  if( argc > 1 )
+  {
+    pcTestDataDir = argv[ 1 ];
+  }
+
+  for( ; pxTests->pcName != NULL; pxTests++ )
+  {
+    ulBefore = ulTestFailures;
+    pxTests->pxRun();
+    ulRun++;
+    if( ulTestFailures != ulBefore )
+    {
+      ulFailed++;
+      printf( "FAIL %s\n", pxTests->pcName );
+    }
+    else
+    {
+      printf( "ok   %s\n", pxTests->pcName );
+    }
+  }
+
+  printf( "%lu/%lu passed\n", ulRun - ulFailed, ulRun );
+  return ulFailed ? 1 : 0;
+}
+
+const char *test_data_path(const char *pcName)
+{
+  static char cPath[ 512 ];
+
+  snprintf( cPath, sizeof( cPath ), "%s/%s", pcTestDataDir, pcName );
+  return cPath;
+}
+
+const char *test_output_path(const char *pcName)
+{
+  static char cPath[ 512 ];
+
+  snprintf( cPath, sizeof( cPath ), "%s.%s", pcTestProgram, pcName );
+  return cPath;
+}
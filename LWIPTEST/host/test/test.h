@@ -0,0 +1,65 @@
+/*
+ * test.h
+ *
+ * Minimal test runner for the host tests: each test is a function, CHECK()
+ * reports a failed condition and lets the test go on, TEST_ASSERT() ends the
+ * test.
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+
+extern unsigned long ulTestFailures;
+extern const char *pcTestDataDir;
+extern const char *pcTestProgram;
+
+#define CHECK( cond )                                                       \
+  do {                                                                      \
+    if( !( cond ) )                                                         \
+    {                                                                       \
+      fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond ); \
+      ulTestFailures++;                                                     \
+    }                                                                       \
+  } while( 0 )
+
+#define CHECK_EQ( a, b )                                                    \
+  do {                                                                      \
+    unsigned long ulA_ = ( unsigned long )( a ), ulB_ = ( unsigned long )( b ); \
+    if( ulA_ != ulB_ )                                                      \
+    {                                                                       \
+      fprintf( stderr, "%s:%d: check failed: %s == %s (%lu != %lu)\n",      \
+               __FILE__, __LINE__, #a, #b, ulA_, ulB_ );                    \
+      ulTestFailures++;                                                     \
+    }                                                                       \
+  } while( 0 )
+
+#define TEST_ASSERT( cond )                                                 \
+  do {                                                                      \
+    if( !( cond ) )                                                         \
+    {                                                                       \
+      fprintf( stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #cond ); \
+      ulTestFailures++;                                                     \
+      return;                                                               \
+    }                                                                       \
+  } while( 0 )
+
+typedef struct
+{
+  const char *pcName;
+  void (*pxRun)(void);
+} test_case_t;
+
+/* Run the tests, argv[1] being the directory of the test data. Returns the
+ * exit status of the test program. */
+extern int test_main(const test_case_t *pxTests, int argc, char **argv);
+
+/* Path of a file of the test data directory, in a static buffer. */
+extern const char *test_data_path(const char *pcName);
+
+/* Path of a file written by the test, next to the test program, in a static
+ * buffer. */
+extern const char *test_output_path(const char *pcName);
+
+#endif /* _TEST_H_ */
@@ -0,0 +1,521 @@
+/*
+ * test_ethernetif.c
+ *
+ * lwIP port tests on the simulated MACB: frames lwIP holds on to while the
+ * reception goes on (pbufs kept by netif->input, IP fragments waiting for
+ * reassembly), running out of zero-copy custom pbufs, an ARP reply built in
+ * the received request while the Rx ring is reused, the Rx prefilter letting
+ * DHCP replies through, and the INIT-REBOOT of a cached DHCP lease. Built
+ * once per port variant (copy, Rx and Tx zero-copy).
+ */
+
+#include <string.h>
+
+#include "compiler.h"
+#include "macb.h"
+#include "conf_eth.h"
+#include "sim_macb.h"
+#include "test.h"
+
+#include "lwip/dhcp.h"
+#include "lwip/init.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "netif/etharp.h"
+#include "netif/ethernetif.h"
+
+#define NB_RX           ETHERNET_CONF_NB_RX_BUFFERS
+#define MAX_FRAME       1514
+#define MAX_TX_FRAMES   8
+#define MAX_HELD        ( 3 * NB_RX )
+#define UDP_PORT        7777
+
+static const unsigned char ucMac[ 6 ] =
+{
+  ETHERNET_CONF_ETHADDR0, ETHERNET_CONF_ETHADDR1, ETHERNET_CONF_ETHADDR2,
+  ETHERNET_CONF_ETHADDR3, ETHERNET_CONF_ETHADDR4, ETHERNET_CONF_ETHADDR5
+};
+
+static const unsigned char ucIp[ 4 ] =
+{
+  ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, ETHERNET_CONF_IPADDR3
+};
+
+static const unsigned char ucPeer[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const unsigned char ucPeerIp[ 4 ] = { ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, 10 };
+
+extern err_t ethernetif_init(struct netif *netif);
+
+static struct netif xNetif;
+static bool xNetifAdded = false;
+
+/* Frames built by the tests. */
+static unsigned char ucFrames[ 4 ][ MAX_FRAME ];
+
+/* Frames sent by the simulated MACB. */
+static unsigned char ucSent[ MAX_TX_FRAMES ][ MAX_FRAME ];
+static unsigned long ulSentLength[ MAX_TX_FRAMES ];
+static unsigned long ulSentCount;
+
+/* Frames passed to prvHoldInput(), the first ulHoldLimit ones kept. */
+static struct pbuf *pxHeld[ MAX_HELD ];
+static unsigned long ulHeld, ulHoldLimit, ulInputs;
+
+/* Last datagram received on UDP_PORT. */
+static unsigned char ucUdp[ MAX_FRAME ];
+static unsigned long ulUdpLength;
+
+static void prvTxCollect(const unsigned char *pucFrame, unsigned long ulLength, void *pvArg)
+{
+  ( void )pvArg;
+  if( ( ulSentCount < MAX_TX_FRAMES ) && ( ulLength <= MAX_FRAME ) )
+  {
+    memcpy( ucSent[ ulSentCount ], pucFrame, ulLength );
+    ulSentLength[ ulSentCount ] = ulLength;
+  }
+  ulSentCount++;
+}
+
+//!
+//! \brief netif->input keeping the first ulHoldLimit frames, with their
+//! Ethernet header hidden as ethernet_input() does.
+//!
+static err_t prvHoldInput(struct pbuf *p, struct netif *netif)
+{
+  ( void )netif;
+  ulInputs++;
+  if( ulHeld < ulHoldLimit )
+  {
+    pbuf_header( p, -SIZEOF_ETH_HDR );
+    pxHeld[ ulHeld++ ] = p;
+  }
+  else
+  {
+    pbuf_free( p );
+  }
+  return ERR_OK;
+}
+
+static void prvReleaseHeld(void)
+{
+  while( ulHeld != 0 )
+  {
+    pbuf_free( pxHeld[ --ulHeld ] );
+  }
+}
+
+static void prvUdpRecv(void *pvArg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port)
+{
+  ( void )pvArg;
+  ( void )pcb;
+  ( void )addr;
+  ( void )port;
+  ulUdpLength = pbuf_copy_partial( p, ucUdp, sizeof( ucUdp ), 0 );
+  pbuf_free( p );
+}
+
+//!
+//! \brief Build in ucFrames[ ulSlot ] a frame from the peer to the board,
+//! its payload depending on ulSeed.
+//!
+static unsigned char *prvFrame(unsigned long ulSlot, unsigned short usType, unsigned long ulLength, unsigned long ulSeed)
+{
+  unsigned char *pucFrame = ucFrames[ ulSlot ];
+  unsigned long ulIndex;
+
+  memcpy( pucFrame, ucMac, 6 );
+  memcpy( pucFrame + 6, ucPeer, 6 );
+  pucFrame[ 12 ] = usType >> 8;
+  pucFrame[ 13 ] = usType & 0xff;
+  for( ulIndex = 14; ulIndex < ulLength; ulIndex++ )
+  {
+    pucFrame[ ulIndex ] = ( unsigned char )( ulIndex * 7 + ulSeed );
+  }
+  return pucFrame;
+}
+
+//!
+//! \brief Build in ucFrames[ ulSlot ] an IPv4 fragment from the peer,
+//! carrying ulLength bytes of pucData at ulOffset in the datagram.
+//!
+static unsigned long prvFragment(unsigned long ulSlot, const unsigned char *pucData, unsigned long ulOffset, unsigned long ulLength, bool xMore)
+{
+  unsigned char *pucFrame = prvFrame( ulSlot, ETHTYPE_IP, 0, 0 );
+  unsigned char *pucIp = pucFrame + SIZEOF_ETH_HDR;
+  unsigned short usChecksum;
+
+  memset( pucIp, 0, IP_HLEN );
+  pucIp[ 0 ] = 0x45;
+  pucIp[ 2 ] = ( IP_HLEN + ulLength ) >> 8;
+  pucIp[ 3 ] = ( IP_HLEN + ulLength ) & 0xff;
+  pucIp[ 5 ] = 1;
+  pucIp[ 6 ] = ( ( xMore ? IP_MF : 0 ) | ( ulOffset / 8 ) ) >> 8;
+  pucIp[ 7 ] = ( ulOffset / 8 ) & 0xff;
+  pucIp[ 8 ] = 64;
+  pucIp[ 9 ] = IP_PROTO_UDP;
+  memcpy( pucIp + 12, ucPeerIp, 4 );
+  memcpy( pucIp + 16, ucIp, 4 );
+  usChecksum = inet_chksum( pucIp, IP_HLEN );
+  memcpy( pucIp + 10, &usChecksum, 2 );
+  memcpy( pucIp + IP_HLEN, pucData + ulOffset, ulLength );
+  return SIZEOF_ETH_HDR + IP_HLEN + ulLength;
+}
+
+//!
+//! \brief Build in ucFrames[ ulSlot ] a UDP datagram from the DHCP server
+//! port of the peer to pucDest:usPort, carrying ulLength bytes of pucData.
+//!
+static unsigned long prvUdp(unsigned long ulSlot, const unsigned char *pucDest, unsigned short usPort, const unsigned char *pucData, unsigned long ulLength)
+{
+  static unsigned char ucDatagram[ 8 + 300 ];
+  unsigned char *pucIp = ucFrames[ ulSlot ] + SIZEOF_ETH_HDR;
+  unsigned short usChecksum;
+  unsigned long ulFrame;
+
+  memset( ucDatagram, 0, 8 );
+  ucDatagram[ 1 ] = DHCP_SERVER_PORT;
+  ucDatagram[ 2 ] = usPort >> 8;
+  ucDatagram[ 3 ] = usPort & 0xff;
+  ucDatagram[ 4 ] = ( 8 + ulLength ) >> 8;
+  ucDatagram[ 5 ] = ( 8 + ulLength ) & 0xff;
+  memcpy( ucDatagram + 8, pucData, ulLength );
+  ulFrame = prvFragment( ulSlot, ucDatagram, 0, 8 + ulLength, false );
+  memcpy( pucIp + 16, pucDest, 4 );
+  memset( pucIp + 10, 0, 2 );
+  usChecksum = inet_chksum( pucIp, IP_HLEN );
+  memcpy( pucIp + 10, &usChecksum, 2 );
+  return ulFrame;
+}
+
+//!
+//! \brief DHCP reply of type ucType (OFFER, ACK) giving pucOffered, from the
+//! peer, for the transaction xid.
+//!
+static unsigned long prvDhcpReply(unsigned char *pucTo, u32_t xid, unsigned char ucType, const unsigned char *pucOffered)
+{
+  unsigned char *pucOption = pucTo + 240;
+
+  memset( pucTo, 0, 300 );
+  pucTo[ 0 ] = 2;             // BOOTREPLY
+  pucTo[ 1 ] = 1;
+  pucTo[ 2 ] = 6;
+  pucTo[ 4 ] = xid >> 24;
+  pucTo[ 5 ] = xid >> 16;
+  pucTo[ 6 ] = xid >> 8;
+  pucTo[ 7 ] = xid;
+  memcpy( pucTo + 16, pucOffered, 4 );
+  memcpy( pucTo + 28, ucMac, 6 );
+  memcpy( pucTo + 236, "\x63\x82\x53\x63", 4 );
+  *pucOption++ = 53;                                         // message type
+  *pucOption++ = 1;
+  *pucOption++ = ucType;
+  *pucOption++ = 54;                                         // server id
+  *pucOption++ = 4;
+  memcpy( pucOption, ucPeerIp, 4 );
+  pucOption += 4;
+  memcpy( pucOption, "\x33\x04\x00\x00\x0e\x10", 6 );      // 1 h lease
+  pucOption += 6;
+  *pucOption = 255;
+  return 300;
+}
+
+//!
+//! \brief Receive a frame and pass it to lwIP.
+//!
+static void prvReceive(const unsigned char *pucFrame, unsigned long ulLength)
+{
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, ulLength ), SIM_RX_OK );
+  CHECK_EQ( ethernetif_input_burst( &xNetif, ETHERNET_CONF_RX_BUDGET ), 1 );
+}
+
+//!
+//! \brief Receive enough frames of an unknown type, dropped by lwIP, to go
+//! twice round the Rx ring.
+//!
+static void prvCycleRing(void)
+{
+  unsigned long ulFrame;
+
+  for( ulFrame = 0; ulFrame < 2 * NB_RX; ulFrame++ )
+  {
+    prvReceive( prvFrame( 3, 0x88b5, 60, ulFrame ), 60 );
+  }
+}
+
+static void prvInit(void)
+{
+  static bool xLwipUp = false;
+  ip_addr_t xIp, xMask, xGateway;
+
+  if( !xLwipUp )
+  {
+    lwip_init();
+    xLwipUp = true;
+  }
+  if( xNetifAdded )
+  {
+    netif_remove( &xNetif );
+  }
+
+  sim_macb_reset();
+  sim_macb_set_tx_handler( prvTxCollect, NULL );
+  ulSentCount = 0;
+  ulHeld = ulHoldLimit = ulInputs = 0;
+  ulUdpLength = 0;
+  memset( &ethernetif_stats, 0, sizeof( ethernetif_stats ) );
+  vMACBSetMACAddress( ucMac );
+
+  IP4_ADDR( &xIp, ucIp[ 0 ], ucIp[ 1 ], ucIp[ 2 ], ucIp[ 3 ] );
+  IP4_ADDR( &xMask, ETHERNET_CONF_NET_MASK0, ETHERNET_CONF_NET_MASK1, ETHERNET_CONF_NET_MASK2, ETHERNET_CONF_NET_MASK3 );
+  IP4_ADDR( &xGateway, ETHERNET_CONF_GATEWAY_ADDR0, ETHERNET_CONF_GATEWAY_ADDR1, ETHERNET_CONF_GATEWAY_ADDR2, ETHERNET_CONF_GATEWAY_ADDR3 );
+  netif_add( &xNetif, &xIp, &xMask, &xGateway, NULL, ethernetif_init, ethernet_input );
+  netif_set_up( &xNetif );
+  netif_set_link_up( &xNetif );
+  xNetifAdded = true;
+
+  // Leave out the gratuitous ARP frames sent on link up.
+  sim_macb_poll();
+  ethernetif_output_flush( &xNetif );
+  ulSentCount = 0;
+  ulMACBTakeEvents();
+}
+
+static void test_rx_held(void)
+{
+  static unsigned char ucCopy[ MAX_FRAME ];
+  unsigned long ulFrame;
+
+  prvInit();
+  xNetif.input = prvHoldInput;
+  ulHoldLimit = 2;
+
+  // 12 and 2 Rx buffers, kept by lwIP.
+  prvReceive( prvFrame( 0, ETHTYPE_IP, MAX_FRAME, 1 ), MAX_FRAME );
+  prvReceive( prvFrame( 1, ETHTYPE_IP, 129, 2 ), 129 );
+  TEST_ASSERT( ulHeld == 2 );
+
+  // The reception goes on over the whole ring.
+  for( ulFrame = 0; ulFrame < 3 * NB_RX; ulFrame++ )
+  {
+    prvReceive( prvFrame( 2, ETHTYPE_IP, ( ulFrame & 1 ) ? 200 : 60, ulFrame ), ( ulFrame & 1 ) ? 200 : 60 );
+  }
+  CHECK_EQ( ulInputs, 2 + 3 * NB_RX );
+  CHECK_EQ( sim_macb_stats.ulRxBna, 0 );
+#if ETHERNET_CONF_RX_ZERO_COPY
+  CHECK_EQ( ethernetif_stats.rx_held_copies, 12 + 2 );
+  CHECK_EQ( ethernetif_stats.rx_pool_copies, 0 );
+#endif
+
+  // The frames kept are intact.
+  CHECK_EQ( pbuf_copy_partial( pxHeld[ 0 ], ucCopy, sizeof( ucCopy ), 0 ), MAX_FRAME - SIZEOF_ETH_HDR );
+  CHECK( memcmp( ucCopy, ucFrames[ 0 ] + SIZEOF_ETH_HDR, MAX_FRAME - SIZEOF_ETH_HDR ) == 0 );
+  CHECK_EQ( pbuf_copy_partial( pxHeld[ 1 ], ucCopy, sizeof( ucCopy ), 0 ), 129 - SIZEOF_ETH_HDR );
+  CHECK( memcmp( ucCopy, ucFrames[ 1 ] + SIZEOF_ETH_HDR, 129 - SIZEOF_ETH_HDR ) == 0 );
+  prvReleaseHeld();
+}
+
+#if ETHERNET_CONF_RX_ZERO_COPY
+static void test_rx_pool_exhausted(void)
+{
+  unsigned long ulFrame;
+
+  prvInit();
+  xNetif.input = prvHoldInput;
+  ulHoldLimit = 2 * NB_RX + 4;
+
+  // The custom pbufs run out after 2 * NB_RX frames kept: the next frames
+  // are copied to PBUF_POOL pbufs, and stay so until the kept frames go.
+  for( ulFrame = 0; ulFrame < 3 * NB_RX; ulFrame++ )
+  {
+    prvReceive( prvFrame( 0, ETHTYPE_IP, 60, ulFrame ), 60 );
+  }
+  CHECK_EQ( ulInputs, 3 * NB_RX );
+  CHECK_EQ( ulHeld, 2 * NB_RX + 4 );
+  CHECK_EQ( ethernetif_stats.rx_held_copies, 2 * NB_RX );
+  CHECK_EQ( ethernetif_stats.rx_pool_copies, NB_RX );
+  CHECK_EQ( sim_macb_stats.ulRxBna, 0 );
+
+  prvReleaseHeld();
+  prvReceive( prvFrame( 0, ETHTYPE_IP, 60, 0 ), 60 );
+  CHECK_EQ( ethernetif_stats.rx_pool_copies, NB_RX );
+}
+#endif
+
+static void test_ip_reassembly(void)
+{
+  static unsigned char ucDatagram[ 8 + 292 ];
+  struct udp_pcb *pcb;
+  unsigned long ulIndex;
+
+  prvInit();
+  pcb = udp_new();
+  TEST_ASSERT( pcb != NULL );
+  udp_bind( pcb, IP_ADDR_ANY, UDP_PORT );
+  udp_recv( pcb, prvUdpRecv, NULL );
+
+  // UDP header, no checksum, then the data.
+  memset( ucDatagram, 0, 8 );
+  ucDatagram[ 1 ] = 7;
+  ucDatagram[ 2 ] = UDP_PORT >> 8;
+  ucDatagram[ 3 ] = UDP_PORT & 0xff;
+  ucDatagram[ 4 ] = sizeof( ucDatagram ) >> 8;
+  ucDatagram[ 5 ] = sizeof( ucDatagram ) & 0xff;
+  for( ulIndex = 8; ulIndex < sizeof( ucDatagram ); ulIndex++ )
+  {
+    ucDatagram[ ulIndex ] = ( unsigned char )( ulIndex * 3 );
+  }
+
+  // lwIP keeps the first fragment (2 Rx buffers) until the second arrives.
+  prvReceive( ucFrames[ 0 ], prvFragment( 0, ucDatagram, 0, 200, true ) );
+  CHECK_EQ( ulUdpLength, 0 );
+  prvCycleRing();
+  CHECK_EQ( sim_macb_stats.ulRxBna, 0 );
+#if ETHERNET_CONF_RX_ZERO_COPY
+  CHECK_EQ( ethernetif_stats.rx_held_copies, 2 );
+#endif
+  prvReceive( ucFrames[ 1 ], prvFragment( 1, ucDatagram, 200, sizeof( ucDatagram ) - 200, false ) );
+
+  CHECK_EQ( ulUdpLength, sizeof( ucDatagram ) - 8 );
+  CHECK( memcmp( ucUdp, ucDatagram + 8, sizeof( ucDatagram ) - 8 ) == 0 );
+  udp_remove( pcb );
+}
+
+static void test_arp_reply(void)
+{
+  unsigned char *pucFrame = prvFrame( 0, ETHTYPE_ARP, 60, 0 );
+  unsigned char *pucReply = ucSent[ 0 ];
+
+  prvInit();
+
+  // Request from the peer for the board address.
+  memset( pucFrame, 0xff, 6 );
+  memcpy( pucFrame + 14, "\x00\x01\x08\x00\x06\x04\x00\x01", 8 );
+  memcpy( pucFrame + 22, ucPeer, 6 );
+  memcpy( pucFrame + 28, ucPeerIp, 4 );
+  memset( pucFrame + 32, 0, 6 );
+  memcpy( pucFrame + 38, ucIp, 4 );
+  memset( pucFrame + 42, 0, 60 - 42 );
+
+  // lwIP builds the reply in the request: the frame must still be right
+  // once the Rx buffer has been reused, before the MACB sends it.
+  prvReceive( pucFrame, 60 );
+  prvCycleRing();
+  CHECK_EQ( sim_macb_poll(), 1 );
+  TEST_ASSERT( ulSentCount == 1 );
+  CHECK( ulSentLength[ 0 ] >= 42 );
+  CHECK( memcmp( pucReply, ucPeer, 6 ) == 0 );
+  CHECK( memcmp( pucReply + 6, ucMac, 6 ) == 0 );
+  CHECK( memcmp( pucReply + 12, "\x08\x06\x00\x01\x08\x00\x06\x04\x00\x02", 10 ) == 0 );
+  CHECK( memcmp( pucReply + 22, ucMac, 6 ) == 0 );
+  CHECK( memcmp( pucReply + 28, ucIp, 4 ) == 0 );
+  CHECK( memcmp( pucReply + 32, ucPeer, 6 ) == 0 );
+  CHECK( memcmp( pucReply + 38, ucPeerIp, 4 ) == 0 );
+  ethernetif_output_flush( &xNetif );
+}
+
+static void test_rx_filter_dhcp(void)
+{
+  static const unsigned char ucOffered[ 4 ] = { ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, 200 };
+  static unsigned char ucOffer[ 300 ];
+  struct udp_pcb *pcb;
+  unsigned long ulLength;
+
+  prvInit();
+  ethernetif_set_rx_filter( ethernetif_default_rx_filter );
+  pcb = udp_new();
+  TEST_ASSERT( pcb != NULL );
+  udp_bind( pcb, IP_ADDR_ANY, UDP_PORT );
+  udp_recv( pcb, prvUdpRecv, NULL );
+
+  // DHCP runs while the netif keeps its static address (fallback).
+  TEST_ASSERT( dhcp_start( &xNetif ) == ERR_OK );
+  sim_macb_poll();
+  ethernetif_output_flush( &xNetif );
+  CHECK_EQ( xNetif.dhcp->state, DHCP_SELECTING );
+
+  // The OFFER unicast to the address offered is let through: lwIP takes it
+  // whatever the destination address, and requests that address.
+  ulLength = prvUdp( 0, ucOffered, DHCP_CLIENT_PORT, ucOffer,
+                     prvDhcpReply( ucOffer, xNetif.dhcp->xid, DHCP_OFFER, ucOffered ) );
+  prvReceive( ucFrames[ 0 ], ulLength );
+  CHECK_EQ( ethernetif_stats.rx_filtered, 0 );
+  CHECK_EQ( xNetif.dhcp->state, DHCP_REQUESTING );
+  CHECK( memcmp( &xNetif.dhcp->offered_ip_addr, ucOffered, 4 ) == 0 );
+  sim_macb_poll();
+  ethernetif_output_flush( &xNetif );
+
+  // Other ports to that address are still dropped in the Rx buffers...
+  ulLength = prvUdp( 0, ucOffered, UDP_PORT, ucOffer, 100 );
+  CHECK_EQ( sim_macb_rx_frame( ucFrames[ 0 ], ulLength ), SIM_RX_OK );
+  ethernetif_input_burst( &xNetif, ETHERNET_CONF_RX_BUDGET );
+  CHECK_EQ( ethernetif_stats.rx_filtered, 1 );
+  CHECK_EQ( ulUdpLength, 0 );
+
+  // ...and get in to our address.
+  ulLength = prvUdp( 0, ucIp, UDP_PORT, ucOffer, 100 );
+  prvReceive( ucFrames[ 0 ], ulLength );
+  CHECK_EQ( ulUdpLength, 100 );
+
+  dhcp_stop( &xNetif );
+  dhcp_cleanup( &xNetif );
+  ethernetif_set_rx_filter( NULL );
+  udp_remove( pcb );
+}
+
+static void test_dhcp_init_reboot(void)
+{
+  static const unsigned char ucCached[ 4 ] = { ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, 201 };
+  static unsigned char ucAck[ 300 ];
+  const unsigned char *pucOption;
+  unsigned long ulLength;
+  ip_addr_t xCached;
+
+  prvInit();
+
+  // A single REQUEST for the cached address, no DISCOVER.
+  IP4_ADDR( &xCached, ucCached[ 0 ], ucCached[ 1 ], ucCached[ 2 ], ucCached[ 3 ] );
+  TEST_ASSERT( dhcp_start_reboot( &xNetif, &xCached ) == ERR_OK );
+  CHECK_EQ( xNetif.dhcp->state, DHCP_REBOOTING );
+  CHECK_EQ( xNetif.dhcp->tries, 1 );
+  CHECK_EQ( sim_macb_poll(), 1 );
+  TEST_ASSERT( ulSentCount == 1 );
+  TEST_ASSERT( ulSentLength[ 0 ] >= SIZEOF_ETH_HDR + IP_HLEN + 8 + 240 + 12 );
+  pucOption = ucSent[ 0 ] + SIZEOF_ETH_HDR + IP_HLEN + 8 + 240;
+  CHECK( memcmp( pucOption, "\x35\x01\x03", 3 ) == 0 );
+  CHECK( memcmp( pucOption + 7, "\x32\x04", 2 ) == 0 );
+  CHECK( memcmp( pucOption + 9, ucCached, 4 ) == 0 );
+  ethernetif_output_flush( &xNetif );
+
+  // The server ACKs it: bound to the cached address.
+  ulLength = prvUdp( 0, ucCached, DHCP_CLIENT_PORT, ucAck,
+                     prvDhcpReply( ucAck, xNetif.dhcp->xid, DHCP_ACK, ucCached ) );
+  prvReceive( ucFrames[ 0 ], ulLength );
+  CHECK_EQ( xNetif.dhcp->state, DHCP_BOUND );
+  CHECK( memcmp( &xNetif.ip_addr, ucCached, 4 ) == 0 );
+
+  sim_macb_poll();
+  ethernetif_output_flush( &xNetif );
+  dhcp_stop( &xNetif );
+  dhcp_cleanup( &xNetif );
+}
+
+static const test_case_t xTests[] =
+{
+  { "rx_held", test_rx_held },
+#if ETHERNET_CONF_RX_ZERO_COPY
+  { "rx_pool_exhausted", test_rx_pool_exhausted },
+#endif
+  { "ip_reassembly", test_ip_reassembly },
+  { "arp_reply", test_arp_reply },
+  { "rx_filter_dhcp", test_rx_filter_dhcp },
+  { "dhcp_init_reboot", test_dhcp_init_reboot },
+  { NULL, NULL }
+};
+
+int main(int argc, char **argv)
+{
+  return test_main( xTests, argc, argv );
+}
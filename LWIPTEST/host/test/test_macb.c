@@ -0,0 +1,462 @@
+/*
+ * test_macb.c
+ *
+ * MACB driver tests on the simulated MACB: Rx descriptor walk over single and
+ * multi-buffer frames, aborted (SOF without EOF) frames, ring overruns (BNA),
+ * address filtering, frames injected from a capture file, and Tx with
+ * back-pressure and Tx errors. Built once per Tx mode (copy, zero-copy).
+ *
+ * test/data/rx.pcap holds, from a peer 02:00:00:00:00:01:
+ *  - a 60-byte broadcast ARP frame,
+ *  - a 98-byte frame to the board MAC address,
+ *  - a 98-byte frame to another unicast address,
+ *  - a 98-byte frame to the multicast address 01:00:5e:00:00:fb,
+ *  - a 1514-byte frame to the board (12 Rx buffers),
+ *  - a 129-byte frame to the board (2 Rx buffers).
+ */
+
+#include <string.h>
+
+#include "compiler.h"
+#include "macb.h"
+#include "conf_eth.h"
+#include "pcap.h"
+#include "sim_macb.h"
+#include "test.h"
+
+#define NB_RX           ETHERNET_CONF_NB_RX_BUFFERS
+#define NB_TX           ETHERNET_CONF_NB_TX_BUFFERS
+#define MAX_FRAME       1514
+#define MAX_TX_FRAMES   32
+
+static const unsigned char ucMac[ 6 ] =
+{
+  ETHERNET_CONF_ETHADDR0, ETHERNET_CONF_ETHADDR1, ETHERNET_CONF_ETHADDR2,
+  ETHERNET_CONF_ETHADDR3, ETHERNET_CONF_ETHADDR4, ETHERNET_CONF_ETHADDR5
+};
+
+static const unsigned char ucPeer[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const unsigned char ucGroup[ 6 ] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb };
+
+/* Frames built by the tests. Tx zero-copy sends straight from them, so they
+are static (below 4 GB) and each frame queued keeps its own. */
+static unsigned char ucFrames[ MAX_TX_FRAMES ][ MAX_FRAME ];
+
+/* Frames sent by the simulated MACB. */
+static unsigned char ucSent[ MAX_TX_FRAMES ][ MAX_FRAME ];
+static unsigned long ulSentLength[ MAX_TX_FRAMES ];
+static unsigned long ulSentCount;
+
+static void prvTxCollect(const unsigned char *pucFrame, unsigned long ulLength, void *pvArg)
+{
+  ( void )pvArg;
+  if( ( ulSentCount < MAX_TX_FRAMES ) && ( ulLength <= MAX_FRAME ) )
+  {
+    memcpy( ucSent[ ulSentCount ], pucFrame, ulLength );
+    ulSentLength[ ulSentCount ] = ulLength;
+  }
+  ulSentCount++;
+}
+
+//!
+//! \brief Build in ucFrames[ ulSlot ] a frame to pucDest, its payload
+//! depending on ulSeed.
+//!
+static unsigned char *prvFrame(unsigned long ulSlot, const unsigned char *pucDest, unsigned long ulLength, unsigned long ulSeed)
+{
+  unsigned char *pucFrame = ucFrames[ ulSlot ];
+  unsigned long ulIndex;
+
+  memcpy( pucFrame, pucDest, 6 );
+  memcpy( pucFrame + 6, ucPeer, 6 );
+  pucFrame[ 12 ] = 0x08;
+  pucFrame[ 13 ] = 0x00;
+  for( ulIndex = 14; ulIndex < ulLength; ulIndex++ )
+  {
+    pucFrame[ ulIndex ] = ( unsigned char )( ulIndex * 7 + ulSeed );
+  }
+  return pucFrame;
+}
+
+static void prvInit(void)
+{
+  sim_macb_reset();
+  sim_macb_set_tx_handler( prvTxCollect, NULL );
+  ulSentCount = 0;
+  vMACBSetMACAddress( ucMac );
+  CHECK( xMACBInit( &AVR32_MACB ) );
+  ulMACBTakeEvents();
+}
+
+//!
+//! \brief Send a frame, in up to four pieces with Tx zero-copy. Minimum size
+//! frames take one Tx buffer in both modes.
+//!
+static void prvSend(const unsigned char *pucFrame, unsigned long ulLength)
+{
+#if ETHERNET_CONF_TX_ZERO_COPY
+  macb_packet_t xPackets[ 4 ];
+  unsigned long ulCount = 0, ulOffset = 0, ulChunk;
+
+  // Header apart, as lwIP sends it, then the payload by 700 bytes.
+  while( ulOffset < ulLength )
+  {
+    ulChunk = ( ( ulOffset == 0 ) && ( ulLength > 60 ) ) ? 14 : ulLength - ulOffset;
+    if( ulChunk > 700 )
+    {
+      ulChunk = 700;
+    }
+    xPackets[ ulCount ].data = ( unsigned char * )pucFrame + ulOffset;
+    xPackets[ ulCount ].len = ulChunk;
+    ulCount++;
+    ulOffset += ulChunk;
+  }
+  CHECK( xMACBSendPackets( &AVR32_MACB, xPackets, ulCount ) );
+#else
+  CHECK_EQ( lMACBSend( &AVR32_MACB, pucFrame, ulLength, true ), ulLength );
+#endif
+}
+
+//!
+//! \brief Check that the next frame received is pucFrame, and release it.
+//!
+static bool prvReceive(const unsigned char *pucFrame, unsigned long ulLength)
+{
+  static unsigned char ucCopy[ MAX_FRAME ];
+  macb_rx_span_t xSpan;
+  bool xOk;
+
+  if( !xMACBNextRxFrame( &xSpan ) )
+  {
+    return false;
+  }
+  xOk = ( xSpan.ulLength == ulLength )
+     && ( xSpan.ulCount == ( ulLength + MACB_RX_BUFFER_SIZE - 1 ) / MACB_RX_BUFFER_SIZE )
+     && ( ulMACBRxFrameCopy( &xSpan, 0, ucCopy, sizeof( ucCopy ) ) == ulLength )
+     && ( memcmp( ucCopy, pucFrame, ulLength ) == 0 );
+  vMACBRxFrameRelease( &xSpan );
+  return xOk;
+}
+
+static void test_rx_single(void)
+{
+  const unsigned char *pucFrame;
+  macb_rx_span_t xSpan;
+
+  prvInit();
+  pucFrame = prvFrame( 0, ucMac, 60, 1 );
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, 60 ), SIM_RX_OK );
+  CHECK( ulMACBTakeEvents() & MACB_EVENT_RX );
+  CHECK( prvReceive( pucFrame, 60 ) );
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+}
+
+static void test_rx_multi_buffer(void)
+{
+  unsigned char ucPart[ 8 ];
+  const unsigned char *pucFrame;
+  macb_rx_span_t xSpan;
+  unsigned long ulFrame;
+
+  prvInit();
+
+  // Partial copies across a buffer boundary.
+  pucFrame = prvFrame( 0, ucMac, MAX_FRAME, 2 );
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, MAX_FRAME ), SIM_RX_OK );
+  TEST_ASSERT( xMACBNextRxFrame( &xSpan ) );
+  CHECK_EQ( xSpan.ulFirst, 0 );
+  CHECK_EQ( xSpan.ulCount, 12 );
+  CHECK_EQ( xSpan.ulLength, MAX_FRAME );
+  CHECK_EQ( ulMACBRxFrameCopy( &xSpan, MACB_RX_BUFFER_SIZE - 3, ucPart, 6 ), 6 );
+  CHECK( memcmp( ucPart, pucFrame + MACB_RX_BUFFER_SIZE - 3, 6 ) == 0 );
+  CHECK_EQ( ulMACBRxFrameCopy( &xSpan, MAX_FRAME - 2, ucPart, 6 ), 2 );
+  CHECK_EQ( ulMACBRxFrameCopy( &xSpan, MAX_FRAME, ucPart, 6 ), 0 );
+  vMACBRxFrameRelease( &xSpan );
+
+  // Full size frames around the ring, across its end.
+  for( ulFrame = 0; ulFrame < 6; ulFrame++ )
+  {
+    pucFrame = prvFrame( 0, ucMac, MAX_FRAME - ulFrame, 3 + ulFrame );
+    CHECK_EQ( sim_macb_rx_frame( pucFrame, MAX_FRAME - ulFrame ), SIM_RX_OK );
+    CHECK( prvReceive( pucFrame, MAX_FRAME - ulFrame ) );
+  }
+  CHECK_EQ( sim_macb_stats.ulRxBna, 0 );
+}
+
+static void test_rx_truncated(void)
+{
+  const unsigned char *pucFrame;
+  macb_rx_span_t xSpan;
+  unsigned long ulFrame;
+
+  prvInit();
+
+  // An aborted frame alone is not returned.
+  pucFrame = prvFrame( 0, ucMac, 1000, 4 );
+  CHECK_EQ( sim_macb_rx_truncated( pucFrame, 1000, 3 ), SIM_RX_OK );
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+
+  // The next frame is, and the buffers of the aborted one are recovered.
+  pucFrame = prvFrame( 1, ucMac, 200, 5 );
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, 200 ), SIM_RX_OK );
+  TEST_ASSERT( xMACBNextRxFrame( &xSpan ) );
+  CHECK_EQ( xSpan.ulFirst, 3 );
+  CHECK_EQ( xSpan.ulLength, 200 );
+  vMACBRxFrameRelease( &xSpan );
+
+  // The whole ring is available again.
+  for( ulFrame = 0; ulFrame < NB_RX; ulFrame++ )
+  {
+    CHECK_EQ( sim_macb_rx_frame( prvFrame( ulFrame, ucMac, 60, ulFrame ), 60 ), SIM_RX_OK );
+  }
+  for( ulFrame = 0; ulFrame < NB_RX; ulFrame++ )
+  {
+    CHECK( prvReceive( ucFrames[ ulFrame ], 60 ) );
+  }
+  CHECK_EQ( sim_macb_stats.ulRxBna, 0 );
+
+  // An aborted frame followed by one that completes, both before the driver
+  // looks at the ring.
+  CHECK_EQ( sim_macb_rx_truncated( prvFrame( 0, ucMac, 600, 6 ), 600, 2 ), SIM_RX_OK );
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 1, ucMac, 300, 7 ), 300 ), SIM_RX_OK );
+  CHECK( prvReceive( ucFrames[ 1 ], 300 ) );
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+}
+
+static void test_rx_bna(void)
+{
+  const unsigned char *pucFrame;
+  unsigned long ulFrame, ulResets;
+  macb_rx_span_t xSpan;
+
+  prvInit();
+  ulResets = ulMACBRxRingResets();
+
+  // One frame per buffer fills the ring, the next one is dropped.
+  for( ulFrame = 0; ulFrame < NB_RX; ulFrame++ )
+  {
+    CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucMac, 60, ulFrame ), 60 ), SIM_RX_OK );
+  }
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucMac, 60, 99 ), 60 ), SIM_RX_BNA );
+  CHECK_EQ( sim_macb_stats.ulRxBna, 1 );
+
+  // The driver restarts the ring from a clean state.
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+  CHECK_EQ( ulMACBRxRingResets(), ulResets + 1 );
+  CHECK( !( AVR32_MACB.rsr & AVR32_MACB_RSR_BNA_MASK ) );
+  pucFrame = prvFrame( 0, ucMac, 300, 8 );
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, 300 ), SIM_RX_OK );
+  TEST_ASSERT( xMACBNextRxFrame( &xSpan ) );
+  CHECK_EQ( xSpan.ulFirst, 0 );
+  vMACBRxFrameRelease( &xSpan );
+
+  // Overrun in the middle of a frame: its first buffers hold a SOF without
+  // EOF, and the ring is reset all the same.
+  for( ulFrame = 0; ulFrame < NB_RX - 3; ulFrame++ )
+  {
+    CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucMac, 60, ulFrame ), 60 ), SIM_RX_OK );
+  }
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucMac, MAX_FRAME, 9 ), MAX_FRAME ), SIM_RX_BNA );
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+  CHECK_EQ( ulMACBRxRingResets(), ulResets + 2 );
+  pucFrame = prvFrame( 0, ucMac, MAX_FRAME, 10 );
+  CHECK_EQ( sim_macb_rx_frame( pucFrame, MAX_FRAME ), SIM_RX_OK );
+  CHECK( prvReceive( pucFrame, MAX_FRAME ) );
+}
+
+static void test_rx_filter(void)
+{
+  static const unsigned char ucBroadcast[ 6 ] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  static const unsigned char ucOther[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x99 };
+
+  prvInit();
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucOther, 60, 1 ), 60 ), SIM_RX_FILTERED );
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucGroup, 60, 2 ), 60 ), SIM_RX_FILTERED );
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucBroadcast, 60, 3 ), 60 ),
+            ETHERNET_CONF_RX_BROADCAST ? SIM_RX_OK : SIM_RX_FILTERED );
+
+  vMACBHashAdd( ucGroup );
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucGroup, 60, 4 ), 60 ), SIM_RX_OK );
+  vMACBHashRemove( ucGroup );
+  CHECK_EQ( sim_macb_rx_frame( prvFrame( 0, ucGroup, 60, 5 ), 60 ), SIM_RX_FILTERED );
+}
+
+static void test_rx_pcap(void)
+{
+  static unsigned char ucFrame[ SIM_PCAP_SNAPLEN ];
+  sim_pcap_t xPcap;
+  macb_rx_span_t xSpan;
+  long lLength;
+
+  prvInit();
+  CHECK_EQ( sim_macb_rx_pcap( test_data_path( "rx.pcap" ) ), 4 );
+  CHECK_EQ( sim_macb_stats.ulRxFiltered, 2 );
+
+  // The frames are received as captured.
+  TEST_ASSERT( sim_pcap_open_read( &xPcap, test_data_path( "rx.pcap" ) ) );
+  while( ( lLength = sim_pcap_read( &xPcap, ucFrame, sizeof( ucFrame ), NULL ) ) > 0 )
+  {
+    if( ( memcmp( ucFrame, ucMac, 6 ) == 0 ) || ( ucFrame[ 0 ] == 0xff ) )
+    {
+      CHECK( prvReceive( ucFrame, lLength ) );
+    }
+  }
+  CHECK_EQ( lLength, 0 );
+  sim_pcap_close( &xPcap );
+  CHECK( !xMACBNextRxFrame( &xSpan ) );
+}
+
+static void test_tx(void)
+{
+  static const unsigned long ulLengths[ 3 ] = { 60, 600, MAX_FRAME };
+  unsigned long ulFrame, ulSent = ulMACBTxFramesSent();
+
+  prvInit();
+  for( ulFrame = 0; ulFrame < 3; ulFrame++ )
+  {
+    prvSend( prvFrame( ulFrame, ucPeer, ulLengths[ ulFrame ], ulFrame ), ulLengths[ ulFrame ] );
+  }
+  CHECK( ulMACBTxBuffersFree() < NB_TX );
+  CHECK_EQ( sim_macb_poll(), 3 );
+  CHECK( ulMACBTakeEvents() & MACB_EVENT_TX );
+  CHECK_EQ( ulMACBTxBuffersFree(), NB_TX );
+  CHECK_EQ( ulMACBTxFramesSent(), ulSent + 3 );
+
+  TEST_ASSERT( ulSentCount == 3 );
+  for( ulFrame = 0; ulFrame < 3; ulFrame++ )
+  {
+    CHECK_EQ( ulSentLength[ ulFrame ], ulLengths[ ulFrame ] );
+    CHECK( memcmp( ucSent[ ulFrame ], ucFrames[ ulFrame ], ulLengths[ ulFrame ] ) == 0 );
+  }
+}
+
+static void test_tx_backpressure(void)
+{
+  unsigned long ulFrame;
+
+  prvInit();
+
+  // The transmitter holds the frames: the ring fills up without waiting.
+  sim_macb_tx_pause( 3 );
+  for( ulFrame = 0; ulFrame < NB_TX; ulFrame++ )
+  {
+    prvSend( prvFrame( ulFrame, ucPeer, 60, ulFrame ), 60 );
+  }
+  CHECK_EQ( ulMACBTxBuffersFree(), 0 );
+  CHECK_EQ( sim_macb_stats.ulTxWaits, 0 );
+  CHECK_EQ( ulSentCount, 0 );
+
+  // The next frame waits until the transmitter frees a buffer.
+  prvSend( prvFrame( NB_TX, ucPeer, 60, NB_TX ), 60 );
+  CHECK_EQ( sim_macb_stats.ulTxWaits, 3 );
+  CHECK_EQ( ulSentCount, NB_TX );
+  CHECK_EQ( sim_macb_poll(), 1 );
+
+  TEST_ASSERT( ulSentCount == NB_TX + 1 );
+  for( ulFrame = 0; ulFrame <= NB_TX; ulFrame++ )
+  {
+    CHECK( memcmp( ucSent[ ulFrame ], ucFrames[ ulFrame ], 60 ) == 0 );
+  }
+  CHECK_EQ( ulMACBTxBuffersFree(), NB_TX );
+}
+
+//!
+//! \brief A Tx error on a frame queued across the end of the ring: the frame
+//! is sent again, then those behind it, each once and in order.
+//!
+static void prvTxError(unsigned long ulIsrBit)
+{
+  unsigned long ulFrame;
+
+  prvInit();
+
+  // Move the ring position close to its end.
+  for( ulFrame = 0; ulFrame < NB_TX - 3; ulFrame++ )
+  {
+    prvSend( prvFrame( ulFrame, ucPeer, 60, ulFrame ), 60 );
+  }
+  CHECK_EQ( sim_macb_poll(), NB_TX - 3 );
+  ulSentCount = 0;
+
+  sim_macb_tx_fail_next( ulIsrBit );
+  for( ulFrame = 0; ulFrame < 6; ulFrame++ )
+  {
+    prvSend( prvFrame( ulFrame, ucPeer, 60, 20 + ulFrame ), 60 );
+  }
+  CHECK_EQ( sim_macb_poll(), 6 );
+  CHECK_EQ( sim_macb_stats.ulTxErrors, 1 );
+
+  TEST_ASSERT( ulSentCount == 6 );
+  for( ulFrame = 0; ulFrame < 6; ulFrame++ )
+  {
+    CHECK( memcmp( ucSent[ ulFrame ], ucFrames[ ulFrame ], 60 ) == 0 );
+  }
+  CHECK_EQ( ulMACBTxBuffersFree(), NB_TX );
+
+  // The ring keeps working after the restart.
+  for( ulFrame = 0; ulFrame < NB_TX + 2; ulFrame++ )
+  {
+    prvSend( prvFrame( ulFrame, ucPeer, 60, 40 + ulFrame ), 60 );
+    CHECK_EQ( sim_macb_poll(), 1 );
+  }
+  CHECK_EQ( ulSentCount, 6 + NB_TX + 2 );
+}
+
+static void test_tx_underrun(void)
+{
+  unsigned long ulUnderruns = ulMACBTxUnderruns();
+
+  prvTxError( AVR32_MACB_ISR_TUND_MASK );
+  CHECK_EQ( ulMACBTxUnderruns(), ulUnderruns + 1 );
+}
+
+static void test_tx_retry_limit(void)
+{
+  unsigned long ulRetryLimits = ulMACBTxRetryLimits();
+
+  prvTxError( AVR32_MACB_ISR_RLE_MASK );
+  CHECK_EQ( ulMACBTxRetryLimits(), ulRetryLimits + 1 );
+}
+
+static void test_tx_capture(void)
+{
+  static unsigned char ucFrame[ SIM_PCAP_SNAPLEN ];
+  sim_pcap_t xPcap;
+  unsigned long long ullTime;
+
+  prvInit();
+  TEST_ASSERT( sim_macb_tx_capture( test_output_path( "tx.pcap" ) ) );
+  prvSend( prvFrame( 0, ucPeer, 60, 1 ), 60 );
+  prvSend( prvFrame( 1, ucPeer, MAX_FRAME, 2 ), MAX_FRAME );
+  CHECK_EQ( sim_macb_poll(), 2 );
+  sim_macb_tx_capture( NULL );
+
+  TEST_ASSERT( sim_pcap_open_read( &xPcap, test_output_path( "tx.pcap" ) ) );
+  CHECK_EQ( sim_pcap_read( &xPcap, ucFrame, sizeof( ucFrame ), &ullTime ), 60 );
+  CHECK( memcmp( ucFrame, ucFrames[ 0 ], 60 ) == 0 );
+  CHECK_EQ( sim_pcap_read( &xPcap, ucFrame, sizeof( ucFrame ), &ullTime ), MAX_FRAME );
+  CHECK( memcmp( ucFrame, ucFrames[ 1 ], MAX_FRAME ) == 0 );
+  CHECK_EQ( sim_pcap_read( &xPcap, ucFrame, sizeof( ucFrame ), &ullTime ), 0 );
+  sim_pcap_close( &xPcap );
+}
+
+static const test_case_t xTests[] =
+{
+  { "rx_single", test_rx_single },
+  { "rx_multi_buffer", test_rx_multi_buffer },
+  { "rx_truncated", test_rx_truncated },
+  { "rx_bna", test_rx_bna },
+  { "rx_filter", test_rx_filter },
+  { "rx_pcap", test_rx_pcap },
+  { "tx", test_tx },
+  { "tx_backpressure", test_tx_backpressure },
+  { "tx_underrun", test_tx_underrun },
+  { "tx_retry_limit", test_tx_retry_limit },
+  { "tx_capture", test_tx_capture },
+  { NULL, NULL }
+};
+
+int main(int argc, char **argv)
+{
+  return test_main( xTests, argc, argv );
+}
@@ -60,12 +60,30 @@
 /*! \name Extended registers for DP83848
  */
 //! @{
+#define PHY_PHYSTS          0x10    //!< Phy Status reg
+#define PHY_FCSCR           0x14    //!< False Carrier Sense Counter reg
+#define PHY_RECR            0x15    //!< Receive Error Counter reg
 #define PHY_RBR             0x17    //!< RMII Bypass reg
 #define PHY_MICR            0x11    //!< Interrupt Control reg
 #define PHY_MISR            0x12    //!< Interrupt Status reg
 #define PHY_PHYCR           0x19    //!< Phy CTRL reg
 //! @}
 
+/*! \name Phy Status Register.
+ */
+//! @{
+#define PHYSTS_DUPLEX       0x0004  //!< Full duplex mode
+#define PHYSTS_SPEED10      0x0002  //!< 10 Mb/s mode
+#define PHYSTS_LINK         0x0001  //!< Valid link established
+//! @}
+
+/*! \name Error counter registers (8-bit, saturating, cleared on read).
+ */
+//! @{
+#define FCSCR_FCSCNT        0x00FF  //!< False carrier events
+#define RECR_RXERCNT        0x00FF  //!< Receive errors
+//! @}
+
 /*! RMII Bypass Register */
 #define RBR_RMII            0x0020  //!< RMII Mode
 /*! \name Interrupt Ctrl Register.
@@ -201,5 +219,33 @@ static inline void ethernet_phy_setup_auto_negotiation(
 	vWriteMDIO(macb, PHY_PHYCR, phy_ctrl);
 }
 
+/*! \brief Speed and duplex mode of a Phy Status register value.
+ *
+ * \return the AVR32_MACB_SPD_MASK and AVR32_MACB_FD_MASK NCFGR bits to set.
+ */
+static inline unsigned long ethernet_phy_macb_mode(unsigned long status)
+{
+	unsigned long mode = 0;
+
+	if (!(status & PHYSTS_SPEED10)) {
+		mode |= AVR32_MACB_SPD_MASK;
+	}
+	if (status & PHYSTS_DUPLEX) {
+		mode |= AVR32_MACB_FD_MASK;
+	}
+	return mode;
+}
+
+/*! \brief Get the speed and duplex mode in use on the link.
+ *
+ * The Phy Status register holds the mode resolved by the auto-negotiation,
+ * or the forced one when it is disabled.
+ *
+ * \return the AVR32_MACB_SPD_MASK and AVR32_MACB_FD_MASK NCFGR bits to set.
+ */
+static inline unsigned long ethernet_phy_get_macb_mode(volatile avr32_macb_t *macb)
+{
+	return ethernet_phy_macb_mode(ulReadMDIO(macb, PHY_PHYSTS));
+}
 
 #endif /* DP83848_H_INCLUDED */
@@ -74,8 +74,18 @@
 # define ETHERNET_CONF_USE_RMII_INTERFACE 0
 #endif
 
-/* Size of each receive buffer - DO NOT CHANGE. */
-#define RX_BUFFER_SIZE    128
+/* Size of each receive buffer - DO NOT CHANGE: the UC3A MACB always fills
+128-byte Rx buffers (it has no Rx buffer size field). Tune the number of
+buffers with ETHERNET_CONF_NB_RX_BUFFERS instead. */
+#define RX_BUFFER_SIZE    MACB_RX_BUFFER_SIZE
+
+/* Size of the largest frame the MACB can receive (NCFGR.BIG not set),
+FCS removed. */
+#define RX_MAX_FRAME_SIZE 1518
+
+#if ETHERNET_CONF_NB_RX_BUFFERS * RX_BUFFER_SIZE < RX_MAX_FRAME_SIZE
+#error ETHERNET_CONF_NB_RX_BUFFERS is too small to hold a full size frame
+#endif
 
 
 /* The buffer addresses written into the descriptors must be aligned so the
@@ -91,6 +101,22 @@ descriptor in the array. */
 one not be immediately available when trying to transmit a frame. */
 #define BUFFER_WAIT_DELAY   ( 2 )
 
+/* Wait for the Tx interrupt to free a buffer. Can be overridden, e.g. to let
+a simulated MACB make progress. */
+#ifndef macbTX_BUFFER_WAIT
+#ifdef FREERTOS_USED
+#define macbTX_BUFFER_WAIT()         vTaskDelay( BUFFER_WAIT_DELAY )
+#else
+#define macbTX_BUFFER_WAIT()         __asm__ __volatile__ ("nop")
+#endif
+#endif
+
+/* Clear bits of the write-one-to-clear status registers (RSR, TSR). Can be
+overridden, e.g. by a simulated MACB that has to see the write. */
+#ifndef macbCLEAR_STATUS
+#define macbCLEAR_STATUS( reg, mask )  ( ( reg ) = ( mask ) )
+#endif
+
 #ifndef FREERTOS_USED
 #define portENTER_CRITICAL           Disable_global_interrupt
 #define portEXIT_CRITICAL            Enable_global_interrupt
@@ -109,6 +135,7 @@ static volatile char pcRxBuffer[ ETHERNET_CONF_NB_RX_BUFFERS * RX_BUFFER_SIZE ];
 #endif
 
 
+#if !ETHERNET_CONF_TX_ZERO_COPY
 /* Buffer read by the MACB DMA.  Must be aligned as described by the comment
 above the ADDRESS_MASK definition. */
 #if defined(__GNUC__)
@@ -117,6 +144,7 @@ static volatile char pcTxBuffer[ ETHERNET_CONF_NB_TX_BUFFERS * ETHERNET_CONF_TX_
 #pragma data_alignment=4
 static volatile char pcTxBuffer[ ETHERNET_CONF_NB_TX_BUFFERS * ETHERNET_CONF_TX_BUFFER_SIZE ];
 #endif
+#endif
 
 /* Descriptors used to communicate between the program and the MACB peripheral.
 These descriptors hold the locations and state of the Rx and Tx buffers.
@@ -192,6 +220,11 @@ static void vResetMacbRxFrames( void );
  */
 static void prvSetupMACAddress(volatile avr32_macb_t *macb);
 
+/*
+ * Select the destination addresses accepted by the MACB.
+ */
+static void prvSetupRxFilter(volatile avr32_macb_t *macb);
+
 /*
  * Configure the MACB for interrupts.
  */
@@ -202,23 +235,201 @@ static void prvSetupMACBInterrupt(volatile avr32_macb_t *macb);
  */
 static bool prvProbePHY(volatile avr32_macb_t *macb);
 
+/*
+ * Set the MACB speed and duplex to the ones the PHY uses.
+ */
+#if !( ETHERNET_CONF_PHY_ASYNC && ETHERNET_CONF_MDIO_QUEUE_LEN )
+static void prvSetupMACBConfig(volatile avr32_macb_t *macb);
+#endif
+static void prvSetMACBMode(volatile avr32_macb_t *macb, unsigned long ulMode);
+
 #ifdef FREERTOS_USED
 /* The semaphore used by the MACB ISR to wake the MACB task. */
 static xSemaphoreHandle xSemaphore = NULL;
 #else
-/* Variable incremented every time a new frame has been received and decremented
-   when a frame has been read. */
-static volatile int DataToRead = 0;
+/* Pending work flags (MACB_EVENT_xxx) set by the MACB and PHY interrupts and
+   cleared by the main loop through ulMACBTakeEvents(). */
+static volatile unsigned long ulMACBEvents = 0;
 #endif
 
 /* Holds the index to the next buffer from which data will be read. */
 volatile unsigned long ulNextRxBuffer = 0;
 
+#if ETHERNET_CONF_PHY_ASYNC
+/* PHY bring-up state, advanced by xMACBPhyTask(). */
+static macb_phy_state_t ePhyState = MACB_PHY_RESET;
+
+/* Set by the PHY ISR: the link status must be read again. */
+static volatile bool xPhyEventPending = false;
+
+/* Time of the last link check, in ms. */
+static unsigned long ulPhyLastPoll = 0;
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+/* MDIO reads of a link check, queued together: MISR (to acknowledge the PHY
+   interrupt), BMSR twice, PHYSTS. */
+#if ETHERNET_CONF_USE_PHY_IT == 1
+#define MACB_PHY_CHECK_READS  4
+#else
+#define MACB_PHY_CHECK_READS  3
+#endif
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN < MACB_PHY_CHECK_READS
+#error ETHERNET_CONF_MDIO_QUEUE_LEN is too small to queue a link check
+#endif
+
+/* A link check is queued: no other one until it completes. */
+static bool xPhyCheckQueued = false;
+
+/* BMSR as read by the link check in progress. */
+static unsigned long ulPhyCheckStatus;
+#endif
+#endif
+
+/* Progress of the walk through the descriptors of the frame starting at
+ulRxScanStart: the descriptors up to ulRxScanIndex (excluded) belong to the
+frame and are not its last one. The walk resumes there on the next call to
+xMACBNextRxFrame() while the frame is incomplete. ulRxScanStart is set to
+ETHERNET_CONF_NB_RX_BUFFERS when no walk is in progress. */
+static unsigned long ulRxScanStart = ETHERNET_CONF_NB_RX_BUFFERS, ulRxScanIndex = 0;
+
+/* Number of multicast addresses added to the hash filter for each of its 64
+bits: several addresses can share a bit. */
+static unsigned char ucHashRefs[ 64 ];
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+/* Deferred MDIO access, see xMACBMdioRead()/xMACBMdioWrite(). */
+typedef struct
+{
+  unsigned short usAddress;
+  unsigned short usValue;
+  bool xWrite;
+  macb_mdio_callback_t pxCallback;
+  void *pvArg;
+} xMDIORequest;
+
+/* Queue of deferred MDIO accesses: ulMdioCount requests from ulMdioHead. The
+request at ulMdioHead is on the management port when xMdioBusy is true. */
+static xMDIORequest xMdioQueue[ ETHERNET_CONF_MDIO_QUEUE_LEN ];
+static unsigned long ulMdioHead = 0, ulMdioCount = 0;
+static bool xMdioBusy = false;
+#endif
+
+#if ETHERNET_CONF_PHY_HEALTH_MS
+/* PHY health gathered by prvPhyHealthSample(). */
+static macb_phy_health_t xPhyHealth;
+
+/* Time of the last PHY health sample, in ms. */
+static unsigned long ulPhyHealthLastSample = 0;
+#endif
+
+/* Number of times prvSetupMACBConfig() changed the MACB speed or duplex. */
+static unsigned long ulLinkModeChanges = 0;
+
+/* Number of times the Rx ring was reset by vResetMacbRxFrames(). */
+static unsigned long ulRxRingResets = 0;
+
+#if ETHERNET_CONF_RX_COALESCING
+/* Frames read since the last vMACBRxCoalesceTick(). */
+static unsigned long ulRxCoalesceFrames = 0;
+
+/* true while the Rx complete interrupt is masked and the Rx ring polled. */
+static bool xRxPolling = false;
 
+/* Number of switches between interrupt and polling mode. */
+static unsigned long ulRxCoalesceSwitches = 0;
+#endif
+
+#if ETHERNET_CONF_RX_ZERO_COPY
+/* Rx buffers currently lent to the upper layer.  A lent buffer keeps its
+ownership bit set so the MACB cannot write to it, but it must not be mistaken
+for a buffer holding a new frame either. */
+static volatile unsigned char ucRxBufferLent[ ETHERNET_CONF_NB_RX_BUFFERS ];
+
+/* Number of entries set in ucRxBufferLent[]. */
+static volatile unsigned long ulRxBuffersLent = 0;
+
+#define prvIsRxBufferLent( ulIndex )  ( ucRxBufferLent[ ulIndex ] != 0 )
+#else
+#define prvIsRxBufferLent( ulIndex )  ( false )
+#endif
+
+/* Holds the index to the next buffer to which data will be written. */
+static unsigned long uxTxBufferIndex = 0;
+
+/* Index of the oldest Tx buffer in use, i.e. the first buffer of the oldest
+frame not released by vClearMACBTxBuffer() yet. */
+static unsigned long uxTxTail = 0;
+
+/* Number of Tx buffers in use, from uxTxTail up to uxTxBufferIndex. */
+static volatile unsigned long ulTxBuffersInUse = 0;
+
+/* Number of frames whose Tx buffers have been freed by vClearMACBTxBuffer(). */
+static volatile unsigned long ulTxFramesSent = 0;
+
+/* Number of Tx underruns and of frames given up after too many collisions. */
+static volatile unsigned long ulTxUnderruns = 0, ulTxRetryLimits = 0;
+
+
+#if ETHERNET_CONF_TX_ZERO_COPY
+bool xMACBSendPackets(volatile avr32_macb_t *macb, const macb_packet_t *pxPackets, unsigned long ulCount)
+{
+  unsigned long ulIndex, ulPacket, ulStatus;
+
+  if( ( ulCount == 0 ) || ( ulCount > ETHERNET_CONF_NB_TX_BUFFERS ) )
+  {
+    return false;
+  }
+
+  // Are enough buffers available ? The frame must not be handed to the MACB
+  // before all its descriptors are filled in.
+  while( ETHERNET_CONF_NB_TX_BUFFERS - ulTxBuffersInUse < ulCount )
+  {
+    // There is no room for the Tx data yet.
+    // Wait a short while, then try again.
+    macbTX_BUFFER_WAIT();
+  }
+
+  portENTER_CRITICAL();
+  {
+    // Fill out the descriptors from the last one backwards so that the first
+    // descriptor, which makes the whole frame visible to the MACB, is written
+    // last.
+    for( ulPacket = ulCount; ulPacket-- > 0; )
+    {
+      ulIndex = ( uxTxBufferIndex + ulPacket ) % ETHERNET_CONF_NB_TX_BUFFERS;
+
+      // Point the descriptor directly at the data: Tx buffers need no
+      // particular alignment.
+      xTxDescriptors[ ulIndex ].addr = ( unsigned long )pxPackets[ ulPacket ].data;
+
+      ulStatus = pxPackets[ ulPacket ].len & ( unsigned long ) AVR32_LENGTH_FRAME;
+      if( ulPacket == ulCount - 1 )
+      {
+        // No more data remains for this frame.
+        ulStatus |= AVR32_LAST_BUFFER;
+      }
+      if( ulIndex == ETHERNET_CONF_NB_TX_BUFFERS - 1 )
+      {
+        ulStatus |= AVR32_TRANSMIT_WRAP;
+      }
+      xTxDescriptors[ ulIndex ].U_Status.status = ulStatus;
+    }
+
+    uxTxBufferIndex = ( uxTxBufferIndex + ulCount ) % ETHERNET_CONF_NB_TX_BUFFERS;
+    ulTxBuffersInUse += ulCount;
+
+    // The whole frame is ready, start the transmission.
+    macb->ncr |=  AVR32_MACB_TSTART_MASK;
+  }
+  portEXIT_CRITICAL();
+
+  return true;
+}
+#else
 unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigned long ulLength, long lEndOfFrame)
 {
   const unsigned char *pcFrom = pvFrom;
-  static unsigned long uxTxBufferIndex = 0;
   void *pcBuffer;
   unsigned long ulLastBuffer, ulDataBuffered = 0, ulDataRemainingToSend, ulLengthToSend;
 
@@ -228,22 +439,18 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
   while( ulDataBuffered < ulLength )
   {
     // Is a buffer available ?
-    while( !( xTxDescriptors[ uxTxBufferIndex ].U_Status.status & AVR32_TRANSMIT_OK ) )
+    while( ulTxBuffersInUse >= ETHERNET_CONF_NB_TX_BUFFERS )
     {
       // There is no room to write the Tx data to the Tx buffer.
       // Wait a short while, then try again.
-#ifdef FREERTOS_USED
-      vTaskDelay( BUFFER_WAIT_DELAY );
-#else
-      __asm__ __volatile__ ("nop");
-#endif
+      macbTX_BUFFER_WAIT();
     }
 
     portENTER_CRITICAL();
     {
       // Get the address of the buffer from the descriptor,
       // then copy the data into the buffer.
-      pcBuffer = ( void * ) xTxDescriptors[ uxTxBufferIndex ].addr;
+      pcBuffer = ( void * )( unsigned long )xTxDescriptors[ uxTxBufferIndex ].addr;
 
       // How much can we write to the buffer ?
       ulDataRemainingToSend = ulLength - ulDataBuffered;
@@ -286,6 +493,7 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
                                     | ulLastBuffer;
         uxTxBufferIndex++;
       }
+      ulTxBuffersInUse++;
       /* If this is the last buffer to be sent for this frame we can
          start the transmission. */
       if( ulLastBuffer )
@@ -298,9 +506,40 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
 
   return ulLength;
 }
+#endif
 
+unsigned long ulMACBTxFramesSent(void)
+{
+  return ulTxFramesSent;
+}
+
+unsigned long ulMACBTxBuffersFree(void)
+{
+  return ETHERNET_CONF_NB_TX_BUFFERS - ulTxBuffersInUse;
+}
+
+unsigned long ulMACBTxUnderruns(void)
+{
+  return ulTxUnderruns;
+}
 
-unsigned long ulMACBInputLength(void)
+unsigned long ulMACBTxRetryLimits(void)
+{
+  return ulTxRetryLimits;
+}
+
+unsigned long ulMACBLinkModeChanges(void)
+{
+  return ulLinkModeChanges;
+}
+
+unsigned long ulMACBRxRingResets(void)
+{
+  return ulRxRingResets;
+}
+
+
+bool xMACBNextRxFrame(macb_rx_span_t *pxSpan)
 {
   register unsigned long ulIndex , ulLength = 0;
   unsigned int uiTemp;
@@ -309,18 +548,40 @@ unsigned long ulMACBInputLength(void)
   // Check if the MACB encountered a problem.
   ulEventStatus = AVR32_MACB.rsr;
   if( ulEventStatus & AVR32_MACB_RSR_BNA_MASK )
-  {     // MACB couldn't get ownership of a buffer. This could typically
-        // happen if the total numbers of Rx buffers is tailored too small
-        // for a noisy network with big frames.
-        // We might as well restore ownership of all buffers to the MACB to
-        // restart from a clean state.
-    vResetMacbRxFrames();
-    return( ulLength );
+  {
+#if ETHERNET_CONF_RX_ZERO_COPY
+    if( ulRxBuffersLent )
+    {
+      // The MACB ran into a buffer still held by the upper layer. It will
+      // resume by itself once that buffer is returned, so keep the frames
+      // already received and just acknowledge the event.
+      macbCLEAR_STATUS( AVR32_MACB.rsr, AVR32_MACB_RSR_BNA_MASK );  // Clear
+      AVR32_MACB.rsr; // Read to force the previous write
+    }
+    else
+#endif
+    {
+      // MACB couldn't get ownership of a buffer. This could typically
+      // happen if the total numbers of Rx buffers is tailored too small
+      // for a noisy network with big frames.
+      // We might as well restore ownership of all buffers to the MACB to
+      // restart from a clean state.
+      vResetMacbRxFrames();
+      return false;
+    }
+  }
+
+  // A lent buffer at the read position means the MACB has stopped in front
+  // of it: nothing new has been received yet.
+  if( prvIsRxBufferLent( ulNextRxBuffer ) )
+  {
+    return false;
   }
 
   // Skip any fragments.  We are looking for the first buffer that contains
   // data and has the SOF (start of frame) bit set.
   while( ( xRxDescriptors[ ulNextRxBuffer ].addr & AVR32_OWNERSHIP_BIT )
+        && !prvIsRxBufferLent( ulNextRxBuffer )
         && !( xRxDescriptors[ ulNextRxBuffer ].U_Status.status & AVR32_SOF ) )
   {
     // Ignoring this buffer.  Mark it as free again.
@@ -334,25 +595,32 @@ unsigned long ulMACBInputLength(void)
   }
 
   // We are going to walk through the descriptors that make up this frame,
-  // but don't want to alter ulNextRxBuffer as this would prevent vMACBRead()
-  // from finding the data.  Therefore use a copy of ulNextRxBuffer instead.
-  ulIndex = ulNextRxBuffer;
+  // but don't want to alter ulNextRxBuffer as the frame stays in the ring
+  // until its span is consumed.  Therefore use a separate index, resuming
+  // where the previous call stopped if the frame was incomplete then.
+  if( ulRxScanStart == ulNextRxBuffer )
+  {
+    ulIndex = ulRxScanIndex;
+  }
+  else
+  {
+    ulIndex = ulNextRxBuffer;
+  }
 
   // Walk through the descriptors until we find the last buffer for this frame.
   // The last buffer will give us the length of the entire frame.
-  while ( xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT )
+  for( ;; )
   {
-    ulLength = xRxDescriptors[ ulIndex ].U_Status.status & AVR32_LENGTH_FRAME;
-    if (ulLength) break; //return ulLength
-
-    // Increment to the next buffer, wrapping if necessary.
-    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS ) ulIndex = 0;
-
-    // Is the descriptor valid?
-    if (!(xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT)) break; //return 0
+    // Is the descriptor valid? Did the MACB stop in front of a lent buffer?
+    // Either way the frame is incomplete.
+    if( !( xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT )
+       || ( ( ulIndex != ulNextRxBuffer ) && prvIsRxBufferLent( ulIndex ) ) )
+    {
+      break; //return 0
+    }
 
     // Is it a SOF? If so, the head packet is bad and should be discarded
-    if (xRxDescriptors[ ulIndex ].U_Status.status & AVR32_SOF)
+    if( ( ulIndex != ulNextRxBuffer ) && ( xRxDescriptors[ ulIndex ].U_Status.status & AVR32_SOF ) )
     {
       // Mark the buffers of the CURRENT, FAULTY packet available.
       unsigned int i = ulNextRxBuffer;
@@ -365,116 +633,150 @@ unsigned long ulMACBInputLength(void)
       ulNextRxBuffer=ulIndex;
       // We have the start of a new packet, look at that one instead.
     }
+
+    ulLength = xRxDescriptors[ ulIndex ].U_Status.status & AVR32_LENGTH_FRAME;
+    if( ulLength )
+    {
+      break; //return ulLength
+    }
+
+    // Increment to the next buffer, wrapping if necessary.
+    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS ) ulIndex = 0;
+
+    // The whole ring without an end of frame: leave it to the BNA handling.
+    if( ulIndex == ulNextRxBuffer ) break; //return 0
   }
-  return ulLength;
+
+  if( ulLength )
+  {
+    // Frame complete, the next call starts a new walk.
+    ulRxScanStart = ETHERNET_CONF_NB_RX_BUFFERS;
+    pxSpan->ulFirst = ulNextRxBuffer;
+    pxSpan->ulCount = ( ( ulIndex + ETHERNET_CONF_NB_RX_BUFFERS - ulNextRxBuffer ) % ETHERNET_CONF_NB_RX_BUFFERS ) + 1;
+    pxSpan->ulLength = ulLength;
+  }
+  else
+  {
+    ulRxScanStart = ulNextRxBuffer;
+    ulRxScanIndex = ulIndex;
+  }
+#if ETHERNET_CONF_RX_COALESCING
+  if( ulLength ) ulRxCoalesceFrames++;
+#endif
+  return ( ulLength != 0 );
 }
 /*-----------------------------------------------------------*/
 
-void vMACBRead(void *pvTo, unsigned long ulSectionLength, unsigned long ulTotalFrameLength)
+unsigned long ulMACBRxFrameCopy(const macb_rx_span_t *pxSpan, unsigned long ulOffset, void *pvTo, unsigned long ulLength)
 {
   unsigned char *pcTo = pvTo;
-  static unsigned long ulSectionBytesReadSoFar = 0, ulBufferPosition = 0, ulFrameBytesReadSoFar = 0;
-  static const unsigned char *pcSource;
-  register unsigned long ulBytesRemainingInBuffer, ulRemainingSectionBytes;
-  unsigned int uiTemp;
+  unsigned long ulIndex, ulBufferPosition, ulLengthToCopy, ulCopied = 0;
 
-  // Read ulSectionLength bytes from the Rx buffers.
-  // This is not necessarily any correspondence between the length of our Rx buffers,
-  // and the length of the data we are returning or the length of the data being requested.
-  // Therefore, between calls  we have to remember not only which buffer we are currently
-  // processing, but our position within that buffer.
-  // This would be greatly simplified if PBUF_POOL_BUFSIZE could be guaranteed to be greater
-  // than the size of each Rx buffer, and that memory fragmentation did not occur.
-
-  // This function should only be called after a call to ulMACBInputLength().
-  // This will ensure ulNextRxBuffer is set to the correct buffer. */
-
-  // vMACBRead is called with pcTo set to NULL to indicate that we are about
-  // to read a new frame.  Any fragments remaining in the frame we were
-  // processing during the last call should be dropped.
-  if( pcTo == NULL )
+  // Don't read past the end of the frame.
+  if( ulOffset >= pxSpan->ulLength )
   {
-    // How many bytes are indicated as being in this buffer?
-    // If none then the buffer is completely full and the frame is contained within more
-    // than one buffer.
-    // Reset our state variables ready for the next read from this buffer.
-    pcSource = ( unsigned char * )( xRxDescriptors[ ulNextRxBuffer ].addr & ADDRESS_MASK );
-    ulFrameBytesReadSoFar = ( unsigned long ) 0;
-    ulBufferPosition = ( unsigned long ) 0;
+    return 0;
   }
-  else
+  if( ulLength > pxSpan->ulLength - ulOffset )
+  {
+    ulLength = pxSpan->ulLength - ulOffset;
+  }
+
+  // All the buffers of a frame but the last one are full, so the buffer
+  // holding ulOffset is found without walking the descriptors.
+  ulIndex = pxSpan->ulFirst + ulOffset / RX_BUFFER_SIZE;
+  if( ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS )
+  {
+    ulIndex -= ETHERNET_CONF_NB_RX_BUFFERS;
+  }
+  ulBufferPosition = ulOffset % RX_BUFFER_SIZE;
+
+  while( ulCopied < ulLength )
   {
-    // Loop until we have obtained the required amount of data.
-    ulSectionBytesReadSoFar = 0;
-    while( ulSectionBytesReadSoFar < ulSectionLength )
+    // Copy up to the end of this buffer, then move onto the next one.
+    ulLengthToCopy = RX_BUFFER_SIZE - ulBufferPosition;
+    if( ulLengthToCopy > ulLength - ulCopied )
     {
-      // We may have already read some data from this buffer.
-      // How much data remains in the buffer?
-      ulBytesRemainingInBuffer = ( RX_BUFFER_SIZE - ulBufferPosition );
+      ulLengthToCopy = ulLength - ulCopied;
+    }
+    memcpy( &( pcTo[ ulCopied ] ),
+            ( unsigned char * )( xRxDescriptors[ ulIndex ].addr & ADDRESS_MASK ) + ulBufferPosition,
+            ulLengthToCopy );
+    ulCopied += ulLengthToCopy;
+    ulBufferPosition = 0;
+    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS )
+    {
+      ulIndex = 0;
+    }
+  }
 
-      // How many more bytes do we need to read before we have the
-      // required amount of data?
-      ulRemainingSectionBytes = ulSectionLength - ulSectionBytesReadSoFar;
+  return ulCopied;
+}
 
-      // Do we want more data than remains in the buffer?
-      if( ulRemainingSectionBytes > ulBytesRemainingInBuffer )
-      {
-        // We want more data than remains in the buffer so we can
-        // write the remains of the buffer to the destination, then move
-        // onto the next buffer to get the rest.
-        memcpy( &( pcTo[ ulSectionBytesReadSoFar ] ), &( pcSource[ ulBufferPosition ] ), ulBytesRemainingInBuffer );
-        ulSectionBytesReadSoFar += ulBytesRemainingInBuffer;
-        ulFrameBytesReadSoFar += ulBytesRemainingInBuffer;
-
-        // Mark the buffer as free again.
-        uiTemp = xRxDescriptors[ ulNextRxBuffer ].addr;
-        xRxDescriptors[ ulNextRxBuffer ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
-        // Move onto the next buffer.
-        ulNextRxBuffer++;
-
-        if( ulNextRxBuffer >= ETHERNET_CONF_NB_RX_BUFFERS )
-        {
-          ulNextRxBuffer = ( unsigned long ) 0;
-        }
-
-        // Reset the variables for the new buffer.
-        pcSource = ( unsigned char * )( xRxDescriptors[ ulNextRxBuffer ].addr & ADDRESS_MASK );
-        ulBufferPosition = ( unsigned long ) 0;
-      }
-      else
-      {
-        // We have enough data in this buffer to send back.
-        // Read out enough data and remember how far we read up to.
-        memcpy( &( pcTo[ ulSectionBytesReadSoFar ] ), &( pcSource[ ulBufferPosition ] ), ulRemainingSectionBytes );
-
-        // There may be more data in this buffer yet.
-        // Increment our position in this buffer past the data we have just read.
-        ulBufferPosition += ulRemainingSectionBytes;
-        ulSectionBytesReadSoFar += ulRemainingSectionBytes;
-        ulFrameBytesReadSoFar += ulRemainingSectionBytes;
-
-        // Have we now finished with this buffer?
-        if( ( ulBufferPosition >= RX_BUFFER_SIZE ) || ( ulFrameBytesReadSoFar >= ulTotalFrameLength ) )
-        {
-          // Mark the buffer as free again.
-          uiTemp = xRxDescriptors[ ulNextRxBuffer ].addr;
-          xRxDescriptors[ ulNextRxBuffer ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
-          // Move onto the next buffer.
-          ulNextRxBuffer++;
-
-          if( ulNextRxBuffer >= ETHERNET_CONF_NB_RX_BUFFERS )
-          {
-            ulNextRxBuffer = 0;
-          }
-
-          pcSource = ( unsigned char * )( xRxDescriptors[ ulNextRxBuffer ].addr & ADDRESS_MASK );
-          ulBufferPosition = 0;
-        }
-      }
+void vMACBRxFrameRelease(const macb_rx_span_t *pxSpan)
+{
+  unsigned long ulIndex = pxSpan->ulFirst, ulBuffer;
+  unsigned int uiTemp;
+
+  for( ulBuffer = 0; ulBuffer < pxSpan->ulCount; ulBuffer++ )
+  {
+    // Mark the buffer as free again.
+    uiTemp = xRxDescriptors[ ulIndex ].addr;
+    xRxDescriptors[ ulIndex ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
+    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS )
+    {
+      ulIndex = 0;
     }
   }
+
+  // Move onto the next frame.
+  ulNextRxBuffer = ulIndex;
 }
 
+#if ETHERNET_CONF_RX_ZERO_COPY
+unsigned long ulMACBRxFrameBuffer(const macb_rx_span_t *pxSpan, unsigned long ulBuffer, void **ppvBuffer)
+{
+  unsigned long ulIndex = ( pxSpan->ulFirst + ulBuffer ) % ETHERNET_CONF_NB_RX_BUFFERS;
+
+  *ppvBuffer = ( void * )( xRxDescriptors[ ulIndex ].addr & ADDRESS_MASK );
+  return ulIndex;
+}
+
+void vMACBRxFrameLend(const macb_rx_span_t *pxSpan)
+{
+  unsigned long ulIndex = pxSpan->ulFirst, ulBuffer;
+
+  // Keep the ownership bits set: the buffers now belong to the caller.
+  portENTER_CRITICAL();
+  for( ulBuffer = 0; ulBuffer < pxSpan->ulCount; ulBuffer++ )
+  {
+    ucRxBufferLent[ ulIndex ] = true;
+    ulRxBuffersLent++;
+    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS )
+    {
+      ulIndex = 0;
+    }
+  }
+  portEXIT_CRITICAL();
+
+  // Move onto the next frame.
+  ulNextRxBuffer = ulIndex;
+}
+
+void vMACBReturnRxBuffer(unsigned long ulIndex)
+{
+  unsigned int uiTemp;
+
+  portENTER_CRITICAL();
+  ucRxBufferLent[ ulIndex ] = false;
+  ulRxBuffersLent--;
+  // Mark the buffer as free again.
+  uiTemp = xRxDescriptors[ ulIndex ].addr;
+  xRxDescriptors[ ulIndex ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
+  portEXIT_CRITICAL();
+}
+#endif
+
 /*-----------------------------------------------------------*/
 void vMACBSetMACAddress(const unsigned char *MACAddress)
 {
@@ -490,12 +792,18 @@ bool xMACBInit(volatile avr32_macb_t *macb)
   ethernet_phy_hw_reset();
 
   // generate a software reset of the phy
+#if ETHERNET_CONF_PHY_ASYNC
+  // Only start it: xMACBPhyTask() waits for its end.
+  vWriteMDIO(macb, PHY_BMCR, ulReadMDIO(macb, PHY_BMCR) | BMCR_RESET);
+  ePhyState = MACB_PHY_RESET;
+#else
   ethernet_phy_sw_reset(macb);
+#endif
 
   // set up registers
   macb->ncr = 0;
-  macb->tsr = ~0UL;
-  macb->rsr = ~0UL;
+  macbCLEAR_STATUS( macb->tsr, ~0UL );
+  macbCLEAR_STATUS( macb->rsr, ~0UL );
 
   if (global_interrupt_enabled) Disable_global_interrupt();
   macb->idr = ~0UL;
@@ -513,6 +821,9 @@ bool xMACBInit(volatile avr32_macb_t *macb)
   // Load our MAC address into the MACB.
   prvSetupMACAddress(macb);
 
+  // Only accept the multicast groups added to the hash filter.
+  prvSetupRxFilter(macb);
+
   // Setup the buffers and descriptors.
   prvSetupDescriptors(macb);
 
@@ -528,6 +839,17 @@ bool xMACBInit(volatile avr32_macb_t *macb)
 # error System clock too fast
 #endif
 
+#if ETHERNET_CONF_PHY_ASYNC
+  // The PHY is brought up later by xMACBPhyTask(): start the MACB right now.
+  portENTER_CRITICAL();
+  {
+    prvSetupMACBInterrupt(macb);
+  }
+  portEXIT_CRITICAL();
+  // Enable Rx and Tx, plus the stats register.
+  macb->ncr = AVR32_MACB_NCR_TE_MASK | AVR32_MACB_NCR_RE_MASK;
+  return (true);
+#else
   // Are we connected?
   if( prvProbePHY(macb) == true )
   {
@@ -542,8 +864,292 @@ bool xMACBInit(volatile avr32_macb_t *macb)
     return (true);
   }
   return (false);
+#endif
 }
 
+#if ETHERNET_CONF_PHY_ASYNC
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+//!
+//! \brief Follow the link from the registers read by a link check.
+//!
+static void prvPhyLinkCheck(unsigned short usAddress, unsigned long ulValue, void *pvArg)
+{
+  ( void )pvArg;
+
+  if( usAddress == PHY_BMSR )
+  {
+    // Link failures are latched: the second read gives the current status.
+    ulPhyCheckStatus = ulValue;
+    return;
+  }
+
+  // PHYSTS, last register of the check.
+  xPhyCheckQueued = false;
+  if( ePhyState < MACB_PHY_LINK_DOWN )
+  {
+    // The PHY was reset since the check was queued.
+    return;
+  }
+  if( ulPhyCheckStatus & BMSR_LSTATUS )
+  {
+    // Auto-negotiation done, or the link renegotiated since the last check:
+    // use the speed and duplex in use.
+    prvSetMACBMode(&AVR32_MACB, ethernet_phy_macb_mode(ulValue));
+    ePhyState = MACB_PHY_LINK_UP;
+  }
+  else
+  {
+    ePhyState = MACB_PHY_LINK_DOWN;
+  }
+}
+#endif
+
+bool xMACBPhyTask(unsigned long ulNow)
+{
+  volatile avr32_macb_t *macb = &AVR32_MACB;
+#if !ETHERNET_CONF_MDIO_QUEUE_LEN
+  unsigned long ulStatus;
+#endif
+
+  switch( ePhyState )
+  {
+  case MACB_PHY_RESET:
+    // Wait for the end of the software reset started by xMACBInit().
+    if( !( ulReadMDIO(macb, PHY_BMCR) & BMCR_RESET ) )
+    {
+      ePhyState = MACB_PHY_PROBE;
+    }
+    break;
+
+  case MACB_PHY_PROBE:
+    // Identify the PHY and start the auto-negotiation, retried until the
+    // PHY answers.
+    if( prvProbePHY(macb) == true )
+    {
+#if ETHERNET_CONF_USE_PHY_IT == 1
+      /* enable interrupts on INT pin */
+      vWriteMDIO( macb, PHY_MICR , ( MICR_INTEN | MICR_INTOE ));
+      /* enable "link change", "speed change" and "duplex change" interrupts for Phy */
+      vWriteMDIO( macb, PHY_MISR , MISR_LINK_INT_EN | MISR_SPD_INT_EN | MISR_DP_INT_EN );
+#endif
+      ePhyState = MACB_PHY_LINK_DOWN;
+      xPhyEventPending = true;
+    }
+    break;
+
+  default:
+    // Check the link on PHY interrupts, and periodically in case one was missed.
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+    // The registers are read by vMACBMdioTask(), without waiting on the
+    // management port: prvPhyLinkCheck() moves the state on. A check is
+    // queued whole, or retried on the next call.
+    if( ( xPhyEventPending || ( ulNow - ulPhyLastPoll >= ETHERNET_CONF_PHY_POLL_MS ) )
+      && !xPhyCheckQueued && ( ETHERNET_CONF_MDIO_QUEUE_LEN - ulMdioCount >= MACB_PHY_CHECK_READS ) )
+    {
+      xPhyEventPending = false;
+      ulPhyLastPoll = ulNow;
+      xPhyCheckQueued = true;
+#if ETHERNET_CONF_USE_PHY_IT == 1
+      // Reading the Interrupt Status register acknowledges the PHY interrupt.
+      xMACBMdioRead(PHY_MISR, NULL, NULL);
+#endif
+      xMACBMdioRead(PHY_BMSR, prvPhyLinkCheck, NULL);
+      xMACBMdioRead(PHY_BMSR, prvPhyLinkCheck, NULL);
+      xMACBMdioRead(PHY_PHYSTS, prvPhyLinkCheck, NULL);
+    }
+#else
+    if( xPhyEventPending || ( ulNow - ulPhyLastPoll >= ETHERNET_CONF_PHY_POLL_MS ) )
+    {
+      xPhyEventPending = false;
+      ulPhyLastPoll = ulNow;
+#if ETHERNET_CONF_USE_PHY_IT == 1
+      // Reading the Interrupt Status register acknowledges the PHY interrupt.
+      ulReadMDIO(macb, PHY_MISR);
+#endif
+      // Link failures are latched: the second read gives the current status.
+      ulReadMDIO(macb, PHY_BMSR);
+      ulStatus = ulReadMDIO(macb, PHY_BMSR);
+
+      if( ( ulStatus & BMSR_LSTATUS ) && ( ePhyState == MACB_PHY_LINK_DOWN ) )
+      {
+        // Auto-negotiation done: use the negotiated speed and duplex.
+        prvSetupMACBConfig(macb);
+        ePhyState = MACB_PHY_LINK_UP;
+      }
+      else if( ulStatus & BMSR_LSTATUS )
+      {
+        // The link may have been renegotiated to another mode since the last
+        // check: follow it.
+        prvSetupMACBConfig(macb);
+      }
+      else if( ePhyState == MACB_PHY_LINK_UP )
+      {
+        ePhyState = MACB_PHY_LINK_DOWN;
+      }
+    }
+#endif
+    break;
+  }
+
+  return ( ePhyState == MACB_PHY_LINK_UP );
+}
+
+macb_phy_state_t eMACBPhyState(void)
+{
+  return ePhyState;
+}
+#endif
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+static bool prvMdioQueue(unsigned short usAddress, unsigned short usValue, bool xWrite, macb_mdio_callback_t pxCallback, void *pvArg)
+{
+  xMDIORequest *pxRequest;
+
+  if( ulMdioCount >= ETHERNET_CONF_MDIO_QUEUE_LEN )
+  {
+    return false;
+  }
+  pxRequest = &xMdioQueue[ ( ulMdioHead + ulMdioCount ) % ETHERNET_CONF_MDIO_QUEUE_LEN ];
+  pxRequest->usAddress = usAddress;
+  pxRequest->usValue = usValue;
+  pxRequest->xWrite = xWrite;
+  pxRequest->pxCallback = pxCallback;
+  pxRequest->pvArg = pvArg;
+  ulMdioCount++;
+  return true;
+}
+
+bool xMACBMdioRead(unsigned short usAddress, macb_mdio_callback_t pxCallback, void *pvArg)
+{
+  return prvMdioQueue(usAddress, 0, false, pxCallback, pvArg);
+}
+
+bool xMACBMdioWrite(unsigned short usAddress, unsigned short usValue, macb_mdio_callback_t pxCallback, void *pvArg)
+{
+  return prvMdioQueue(usAddress, usValue, true, pxCallback, pvArg);
+}
+
+//!
+//! \brief Complete the deferred MDIO access on the management port, which
+//! must be idle, and call its callback.
+//!
+static void prvMdioComplete(volatile avr32_macb_t *macb)
+{
+  xMDIORequest xRequest = xMdioQueue[ ulMdioHead ];
+  unsigned long ulValue;
+
+  // read the register value in maintenance register
+  ulValue = xRequest.xWrite ? xRequest.usValue : ( macb->man & 0x0000ffff );
+  // disable management port
+  macb->ncr &= ~AVR32_MACB_NCR_MPE_MASK;
+
+  // Free the entry before the callback, which may queue another access.
+  ulMdioHead = ( ulMdioHead + 1 ) % ETHERNET_CONF_MDIO_QUEUE_LEN;
+  ulMdioCount--;
+  xMdioBusy = false;
+
+  if( xRequest.pxCallback != NULL )
+  {
+    xRequest.pxCallback( xRequest.usAddress, ulValue, xRequest.pvArg );
+  }
+}
+
+//!
+//! \brief Wait for the end of the deferred MDIO access in progress, if any,
+//! before a synchronous access uses the management port.
+//!
+static void prvMdioSync(volatile avr32_macb_t *macb)
+{
+  if( xMdioBusy )
+  {
+    while( !( macb->nsr & AVR32_MACB_NSR_IDLE_MASK ) );
+    prvMdioComplete(macb);
+  }
+}
+
+void vMACBMdioTask(void)
+{
+  volatile avr32_macb_t *macb = &AVR32_MACB;
+  xMDIORequest *pxRequest;
+
+  if( xMdioBusy )
+  {
+    // Still shifting the frame out ?
+    if( !( macb->nsr & AVR32_MACB_NSR_IDLE_MASK ) )
+    {
+      return;
+    }
+    prvMdioComplete(macb);
+  }
+
+  if( ulMdioCount != 0 )
+  {
+    pxRequest = &xMdioQueue[ ulMdioHead ];
+    // initiate transaction : enable management port
+    macb->ncr |= AVR32_MACB_NCR_MPE_MASK;
+    // Write the PHY configuration frame to the MAN register, without waiting
+    // for its end.
+    macb->man = (AVR32_MACB_SOF_MASK & (0x01<<AVR32_MACB_SOF_OFFSET))  // SOF
+              | (2 << AVR32_MACB_CODE_OFFSET)                          // Code
+              | ((pxRequest->xWrite ? 1 : 2) << AVR32_MACB_RW_OFFSET)  // Write or Read operation
+              | ((EXTPHY_PHY_ADDR & 0x1f) << AVR32_MACB_PHYA_OFFSET)   // Phy Add
+              | (pxRequest->usAddress << AVR32_MACB_REGA_OFFSET)       // Reg Add
+              | (pxRequest->xWrite ? pxRequest->usValue : 0);          // Data
+    xMdioBusy = true;
+  }
+}
+#endif
+
+#if ETHERNET_CONF_PHY_HEALTH_MS
+//!
+//! \brief Gather the PHY registers read for vMACBPhyHealthTask().
+//!
+static void prvPhyHealthSample(unsigned short usAddress, unsigned long ulValue, void *pvArg)
+{
+  ( void )pvArg;
+
+  switch( usAddress )
+  {
+  case PHY_PHYSTS:
+    xPhyHealth.ulPhyStatus = ulValue;
+    break;
+  case PHY_RECR:
+    // The PHY counters clear on read and saturate: accumulate them here.
+    xPhyHealth.ulRxErrors += ulValue & RECR_RXERCNT;
+    break;
+  case PHY_FCSCR:
+    // Last register of a sample.
+    xPhyHealth.ulFalseCarriers += ulValue & FCSCR_FCSCNT;
+    xPhyHealth.ulSamples++;
+    break;
+  }
+}
+
+void vMACBPhyHealthTask(unsigned long ulNow)
+{
+  // The counters are only meaningful once the PHY is set up.
+  if( ( ePhyState < MACB_PHY_LINK_DOWN )
+    || ( ulNow - ulPhyHealthLastSample < ETHERNET_CONF_PHY_HEALTH_MS ) )
+  {
+    return;
+  }
+  // Queue the whole sample or nothing, and retry on the next call.
+  if( ETHERNET_CONF_MDIO_QUEUE_LEN - ulMdioCount < 3 )
+  {
+    return;
+  }
+  ulPhyHealthLastSample = ulNow;
+  xMACBMdioRead(PHY_PHYSTS, prvPhyHealthSample, NULL);
+  xMACBMdioRead(PHY_RECR, prvPhyHealthSample, NULL);
+  xMACBMdioRead(PHY_FCSCR, prvPhyHealthSample, NULL);
+}
+
+void vMACBGetPhyHealth(macb_phy_health_t *pxHealth)
+{
+  *pxHealth = xPhyHealth;
+}
+#endif
+
 void vDisableMACBOperations(volatile avr32_macb_t *macb)
 {
 	bool global_interrupt_enabled = Is_global_interrupt_enabled();
@@ -564,7 +1170,8 @@ void vDisableMACBOperations(volatile avr32_macb_t *macb)
 
 	// We no more want to interrupt on Rx and Tx events.
 	if (global_interrupt_enabled) Disable_global_interrupt();
-	macb->idr = AVR32_MACB_IER_RCOMP_MASK | AVR32_MACB_IER_TCOMP_MASK;
+	macb->idr = AVR32_MACB_IER_RCOMP_MASK | AVR32_MACB_IER_TCOMP_MASK
+	          | AVR32_MACB_IER_TUND_MASK | AVR32_MACB_IER_RLE_MASK;
 	macb->isr;
 	if (global_interrupt_enabled) Enable_global_interrupt();
 }
@@ -572,36 +1179,83 @@ void vDisableMACBOperations(volatile avr32_macb_t *macb)
 
 void vClearMACBTxBuffer(void)
 {
-  static unsigned long uxNextBufferToClear = 0;
+  unsigned long ulStatus;
 
   // Called on Tx interrupt events to set the AVR32_TRANSMIT_OK bit in each
-  // Tx buffer within the frame just transmitted.  This marks all the buffers
-  // as available again.
-
-  // The first buffer in the frame should have the bit set automatically. */
-  if( xTxDescriptors[ uxNextBufferToClear ].U_Status.status & AVR32_TRANSMIT_OK )
+  // Tx buffer of the frames transmitted since the last call.  This marks all
+  // their buffers as available again.
+  // Only the buffers in use, from uxTxTail, are looked at: the MACB sets the
+  // bit in the first buffer of each frame it has sent, so the walk stops at
+  // the first frame not sent yet.
+  while( ( ulTxBuffersInUse != 0 )
+        && ( xTxDescriptors[ uxTxTail ].U_Status.status & AVR32_TRANSMIT_OK ) )
   {
-    // Loop through the other buffers in the frame.
-    while( !( xTxDescriptors[ uxNextBufferToClear ].U_Status.status & AVR32_LAST_BUFFER ) )
+    // Loop through the buffers of the frame, up to its last one.
+    do
     {
-      uxNextBufferToClear++;
+      ulStatus = xTxDescriptors[ uxTxTail ].U_Status.status;
+      xTxDescriptors[ uxTxTail ].U_Status.status = ulStatus | AVR32_TRANSMIT_OK;
+      ulTxBuffersInUse--;
 
-      if( uxNextBufferToClear >= ETHERNET_CONF_NB_TX_BUFFERS )
+      if( ++uxTxTail >= ETHERNET_CONF_NB_TX_BUFFERS )
       {
-        uxNextBufferToClear = 0;
+        uxTxTail = 0;
       }
+    } while( !( ulStatus & AVR32_LAST_BUFFER ) && ( ulTxBuffersInUse != 0 ) );
 
-      xTxDescriptors[ uxNextBufferToClear ].U_Status.status |= AVR32_TRANSMIT_OK;
-    }
+    // The frame has been sent.
+    ulTxFramesSent++;
+  }
+}
+
+//!
+//! \brief Stop the transmitter and move the oldest frame not sent yet,
+//! uxTxTail once the frames sent are released, to the start of the Tx ring.
+//! The MACB restarts from the address written to TBQP, and also goes back
+//! there on the wrap bit: the ring must still start at xTxDescriptors[0].
+//! Clearing TE drops the frame in progress, which is thus sent again from its
+//! start by prvStartTx(). Called with interrupts masked.
+//!
+static void prvStopTx(volatile avr32_macb_t *macb)
+{
+  unsigned int uiAddr[ ETHERNET_CONF_NB_TX_BUFFERS ], uiStatus[ ETHERNET_CONF_NB_TX_BUFFERS ];
+  unsigned long ulIndex, ulFrom;
 
-    // Start with the next buffer the next time a Tx interrupt is called.
-    uxNextBufferToClear++;
+  macb->ncr &= ~AVR32_MACB_NCR_TE_MASK;
+  vClearMACBTxBuffer();
 
-    // Do we need to wrap back to the first buffer?
-    if( uxNextBufferToClear >= ETHERNET_CONF_NB_TX_BUFFERS )
+  if( uxTxTail != 0 )
+  {
+    // Rotate the descriptors, with their buffers, so that uxTxTail comes
+    // first. Only the wrap bit stays on the last descriptor.
+    for( ulIndex = 0; ulIndex < ETHERNET_CONF_NB_TX_BUFFERS; ulIndex++ )
+    {
+      ulFrom = ( uxTxTail + ulIndex ) % ETHERNET_CONF_NB_TX_BUFFERS;
+      uiAddr[ ulIndex ] = xTxDescriptors[ ulFrom ].addr;
+      uiStatus[ ulIndex ] = xTxDescriptors[ ulFrom ].U_Status.status & ~AVR32_TRANSMIT_WRAP;
+    }
+    for( ulIndex = 0; ulIndex < ETHERNET_CONF_NB_TX_BUFFERS; ulIndex++ )
     {
-      uxNextBufferToClear = 0;
+      xTxDescriptors[ ulIndex ].addr = uiAddr[ ulIndex ];
+      xTxDescriptors[ ulIndex ].U_Status.status = uiStatus[ ulIndex ];
     }
+    xTxDescriptors[ ETHERNET_CONF_NB_TX_BUFFERS - 1 ].U_Status.status |= AVR32_TRANSMIT_WRAP;
+
+    uxTxBufferIndex = ( uxTxBufferIndex + ETHERNET_CONF_NB_TX_BUFFERS - uxTxTail ) % ETHERNET_CONF_NB_TX_BUFFERS;
+    uxTxTail = 0;
+  }
+  macb->tbqp = ( unsigned long )xTxDescriptors;
+}
+
+//!
+//! \brief Restart the transmitter stopped by prvStopTx().
+//!
+static void prvStartTx(volatile avr32_macb_t *macb)
+{
+  macb->ncr |= AVR32_MACB_NCR_TE_MASK;
+  if( ulTxBuffersInUse != 0 )
+  {
+    macb->ncr |= AVR32_MACB_TSTART_MASK;
   }
 }
 
@@ -630,8 +1284,13 @@ static void prvSetupDescriptors(volatile avr32_macb_t *macb)
   // initialize xTxDescriptors.
   for( xIndex = 0; xIndex < ETHERNET_CONF_NB_TX_BUFFERS; ++xIndex )
   {
+#if ETHERNET_CONF_TX_ZERO_COPY
+    // The buffer address is set by xMACBSendPackets() for each frame.
+    ulAddress = 0;
+#else
     // Calculate the address of the nth buffer within the array.
     ulAddress = ( unsigned long )( pcTxBuffer + ( xIndex * ETHERNET_CONF_TX_BUFFER_SIZE ) );
+#endif
 
     // Write the buffer address into the descriptor.
     // The DMA will read data from here when the descriptor is being used.
@@ -643,6 +1302,13 @@ static void prvSetupDescriptors(volatile avr32_macb_t *macb)
   // to the first buffer.
   xTxDescriptors[ ETHERNET_CONF_NB_TX_BUFFERS - 1 ].U_Status.status = AVR32_TRANSMIT_WRAP | AVR32_TRANSMIT_OK;
 
+  // Both rings start over, xMACBInit() may be called again.
+  ulNextRxBuffer = 0;
+  ulRxScanStart = ETHERNET_CONF_NB_RX_BUFFERS;
+  uxTxBufferIndex = 0;
+  uxTxTail = 0;
+  ulTxBuffersInUse = 0;
+
   // Tell the MACB where to find the descriptors.
   macb->rbqp =   ( unsigned long )xRxDescriptors;
   macb->tbqp =   ( unsigned long )xTxDescriptors;
@@ -668,13 +1334,16 @@ static void vResetMacbRxFrames( void )
    // Restore ownership of all Rx buffers to the MACB.
    for( ulIndex = 0; ulIndex < ETHERNET_CONF_NB_RX_BUFFERS; ++ulIndex )
    {
+      // Buffers lent to the upper layer are returned by vMACBReturnRxBuffer().
+      if( prvIsRxBufferLent( ulIndex ) ) continue;
+
       // Mark the buffer as owned by the MACB.
       uiTemp = xRxDescriptors[ ulIndex ].addr;
       xRxDescriptors[ ulIndex ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
    }
 
    // Reset the Buffer-not-available bit and the overrun bit.
-   AVR32_MACB.rsr = AVR32_MACB_RSR_BNA_MASK | AVR32_MACB_RSR_OVR_MASK;  // Clear
+   macbCLEAR_STATUS( AVR32_MACB.rsr, AVR32_MACB_RSR_BNA_MASK | AVR32_MACB_RSR_OVR_MASK );  // Clear
    AVR32_MACB.rsr; // We read to force the previous operation.
 
    // Reset the MACB starting point.
@@ -682,9 +1351,12 @@ static void vResetMacbRxFrames( void )
 
    // Reset the index to the next buffer from which data will be read.
    ulNextRxBuffer = 0;
+   ulRxScanStart = ETHERNET_CONF_NB_RX_BUFFERS;
 
    // Enable MACB frame reception.
    AVR32_MACB.ncr |= AVR32_MACB_NCR_RE_MASK;
+
+   ulRxRingResets++;
 }
 
 
@@ -700,6 +1372,73 @@ static void prvSetupMACAddress(volatile avr32_macb_t *macb)
                                     cMACAddress[ 4 ];
 }
 
+static void prvSetupRxFilter(volatile avr32_macb_t *macb)
+{
+  // Empty hash filter: no multicast frame is accepted until a group is added.
+  memset( ucHashRefs, 0, sizeof( ucHashRefs ) );
+  macb->hrb = 0;
+  macb->hrt = 0;
+  macb->ncfgr |= AVR32_MACB_NCFGR_MTI_MASK;
+
+#if !ETHERNET_CONF_RX_BROADCAST
+  // Reject broadcast frames.
+  macb->ncfgr |= AVR32_MACB_NCFGR_NBC_MASK;
+#endif
+}
+
+/*
+ * Index of the hash filter bit matching a destination address: bit i of the
+ * index is the XOR of the address bits i, i+6, ... i+42 (bit 0 being the
+ * first bit on the wire, the LSB of the first byte).
+ */
+static unsigned long prvHashIndex(const unsigned char *pucAddress)
+{
+  unsigned long ulBit, ulIndex = 0;
+
+  for( ulBit = 0; ulBit < 48; ulBit++ )
+  {
+    if( pucAddress[ ulBit / 8 ] & ( 1 << ( ulBit % 8 ) ) )
+    {
+      ulIndex ^= 1 << ( ulBit % 6 );
+    }
+  }
+  return ulIndex;
+}
+
+void vMACBHashAdd(const unsigned char *pucAddress)
+{
+  unsigned long ulIndex = prvHashIndex( pucAddress );
+
+  if( ucHashRefs[ ulIndex ]++ == 0 )
+  {
+    if( ulIndex < 32 )
+    {
+      AVR32_MACB.hrb |= 1UL << ulIndex;
+    }
+    else
+    {
+      AVR32_MACB.hrt |= 1UL << ( ulIndex - 32 );
+    }
+  }
+}
+
+void vMACBHashRemove(const unsigned char *pucAddress)
+{
+  unsigned long ulIndex = prvHashIndex( pucAddress );
+
+  if( ( ucHashRefs[ ulIndex ] != 0 ) && ( --ucHashRefs[ ulIndex ] == 0 ) )
+  {
+    if( ulIndex < 32 )
+    {
+      AVR32_MACB.hrb &= ~( 1UL << ulIndex );
+    }
+    else
+    {
+      AVR32_MACB.hrt &= ~( 1UL << ( ulIndex - 32 ) );
+    }
+  }
+}
+
 #if EXTPHY_MACB_USE_EXTINT
 //! Structure holding the configuration parameters of the EIC module.
 eic_options_t eic_options;
@@ -714,8 +1453,8 @@ static void prvSetupMACBInterrupt(volatile avr32_macb_t *macb)
     vSemaphoreCreateBinary( xSemaphore );
   }
 #else
-  // Init the variable counting the number of received frames not yet read.
-  DataToRead = 0;
+  // No work pending yet.
+  ulMACBEvents = 0;
 #endif
 
 
@@ -765,14 +1504,21 @@ static void prvSetupMACBInterrupt(volatile avr32_macb_t *macb)
     // Register the interrupt handler to the interrupt controller at interrupt level 2
     INTC_register_interrupt((__int_handler)&vPHY_ISR, (AVR32_GPIO_IRQ_0 + (EXTPHY_MACB_INTERRUPT_PIN/8)), AVR32_INTC_INT2);
 	#endif
+#if !ETHERNET_CONF_PHY_ASYNC
     /* enable interrupts on INT pin */
     vWriteMDIO( macb, PHY_MICR , ( MICR_INTEN | MICR_INTOE ));
-    /* enable "link change" interrupt for Phy */
-    vWriteMDIO( macb, PHY_MISR , MISR_LINK_INT_EN );
+    /* enable "link change", "speed change" and "duplex change" interrupts for Phy */
+    vWriteMDIO( macb, PHY_MISR , MISR_LINK_INT_EN | MISR_SPD_INT_EN | MISR_DP_INT_EN );
+#endif
 #endif
 
-    // We want to interrupt on Rx and Tx events
-    macb->ier = AVR32_MACB_IER_RCOMP_MASK | AVR32_MACB_IER_TCOMP_MASK;
+    // We want to interrupt on Rx and Tx events, and on Tx errors
+    macb->ier = AVR32_MACB_IER_RCOMP_MASK | AVR32_MACB_IER_TCOMP_MASK
+              | AVR32_MACB_IER_TUND_MASK | AVR32_MACB_IER_RLE_MASK;
+#if ETHERNET_CONF_RX_COALESCING
+    xRxPolling = false;
+    ulRxCoalesceFrames = 0;
+#endif
 #ifdef FREERTOS_USED
   }
 #endif
@@ -782,6 +1528,9 @@ unsigned long ulReadMDIO(volatile avr32_macb_t *macb, unsigned short usAddress)
 {
   unsigned long value, status;
 
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+  prvMdioSync(macb);
+#endif
   // initiate transaction : enable management port
   macb->ncr |= AVR32_MACB_NCR_MPE_MASK;
   // Write the PHY configuration frame to the MAN register
@@ -806,6 +1555,9 @@ void vWriteMDIO(volatile avr32_macb_t *macb, unsigned short usAddress, unsigned
 {
   unsigned long status;
 
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+  prvMdioSync(macb);
+#endif
   // initiate transaction : enable management port
   macb->ncr |= AVR32_MACB_NCR_MPE_MASK;
   // Write the PHY configuration frame to the MAN register
@@ -823,58 +1575,52 @@ void vWriteMDIO(volatile avr32_macb_t *macb, unsigned short usAddress, unsigned
   macb->ncr &= ~AVR32_MACB_NCR_MPE_MASK;
 }
 
+#if !( ETHERNET_CONF_PHY_ASYNC && ETHERNET_CONF_MDIO_QUEUE_LEN )
 static void prvSetupMACBConfig(volatile avr32_macb_t *macb)
 {
-  volatile unsigned long lpa, config, advertise;
+  // get the speed and duplex mode the PHY actually uses
+  prvSetMACBMode(macb, ethernet_phy_get_macb_mode(macb));
+}
+#endif
 
-  // read the LPA configuration of the PHY
-  lpa = ulReadMDIO(macb, PHY_LPA);
+//!
+//! \brief Set the MACB speed and duplex (AVR32_MACB_SPD_MASK and
+//! AVR32_MACB_FD_MASK bits of ulMode), if they change.
+//!
+static void prvSetMACBMode(volatile avr32_macb_t *macb, unsigned long ulMode)
+{
+  unsigned long ulConfig;
+  bool xTxEnabled;
 
   // read the MACB config register
-  config = macb->ncfgr;
-
-  // set advertise register
-#if ETHERNET_CONF_AN_ENABLE == 1
-  advertise = ADVERTISE_CSMA | ADVERTISE_ALL;
-#else
-  advertise = ADVERTISE_CSMA;
-  #if ETHERNET_CONF_USE_100MB
-    #if ETHERNET_CONF_USE_FULL_DUPLEX
-      advertise |= ADVERTISE_100FULL;
-    #else
-      advertise |= ADVERTISE_100HALF;
-    #endif
-  #else
-    #if ETHERNET_CONF_USE_FULL_DUPLEX
-      advertise |= ADVERTISE_10FULL;
-    #else
-      advertise |= ADVERTISE_10HALF;
-    #endif
-  #endif
-#endif
-
-  // if 100MB needed
-  if ((lpa & advertise) & (LPA_100HALF | LPA_100FULL))
+  ulConfig = macb->ncfgr;
+  if( ( ulConfig & ( AVR32_MACB_SPD_MASK | AVR32_MACB_FD_MASK ) ) == ulMode )
   {
-    config |= AVR32_MACB_SPD_MASK;
-  }
-  else
-  {
-    config &= ~(AVR32_MACB_SPD_MASK);
+    // nothing to change
+    return;
   }
 
-  // if FULL DUPLEX needed
-  if ((lpa & advertise) & (LPA_10FULL | LPA_100FULL))
-  {
-    config |= AVR32_MACB_FD_MASK;
-  }
-  else
+  portENTER_CRITICAL();
   {
-    config &= ~(AVR32_MACB_FD_MASK);
-  }
+    // The configuration must not change under a frame being sent: stop the
+    // transmitter, and make it start again from the beginning of that frame.
+    // The frames queued behind it are left untouched.
+    xTxEnabled = ( ( macb->ncr & AVR32_MACB_NCR_TE_MASK ) != 0 );
+    if( xTxEnabled )
+    {
+      prvStopTx(macb);
+    }
 
-  // write the MACB config register
-  macb->ncfgr = config;
+    // write the MACB config register
+    macb->ncfgr = ( ulConfig & ~( AVR32_MACB_SPD_MASK | AVR32_MACB_FD_MASK ) ) | ulMode;
+    ulLinkModeChanges++;
+
+    if( xTxEnabled )
+    {
+      prvStartTx(macb);
+    }
+  }
+  portEXIT_CRITICAL();
 }
 
 static bool prvProbePHY(volatile avr32_macb_t *macb)
@@ -926,7 +1672,7 @@ static bool prvProbePHY(volatile avr32_macb_t *macb)
     // update ctrl register
     vWriteMDIO(macb, PHY_BMCR, config);
 
-#if (ETHERNET_CONF_USE_PHY_IT == 0)
+#if (ETHERNET_CONF_USE_PHY_IT == 0) && !ETHERNET_CONF_PHY_ASYNC
     volatile unsigned long mii_status;
     // loop while link status isn't OK
     do {
@@ -934,7 +1680,7 @@ static bool prvProbePHY(volatile avr32_macb_t *macb)
     } while (!(mii_status & BMSR_LSTATUS));
 
     prvSetupMACBConfig(macb);
-#endif /* ETHERNET_CONF_USE_PHY_IT == 0 */
+#endif /* ETHERNET_CONF_USE_PHY_IT == 0 && !ETHERNET_CONF_PHY_ASYNC */
 
     return true;
   }
@@ -952,16 +1698,17 @@ bool vMACBWaitForInput(unsigned long ulTimeOut)
 #else
   unsigned long i;
   volatile unsigned long ulEventStatus;
+  macb_rx_span_t xSpan;
 
   i = ulTimeOut * 1000;
   // wait for an interrupt to occurs
   do
   {
-    if ( DataToRead != 0 )
+    if ( ulMACBEvents & MACB_EVENT_RX )
     {
       // IT occurs, reset interrupt flag
       portENTER_CRITICAL();
-      DataToRead--;
+      ulMACBEvents &= ~MACB_EVENT_RX;
       portEXIT_CRITICAL();
       return true;
     }
@@ -973,9 +1720,9 @@ bool vMACBWaitForInput(unsigned long ulTimeOut)
   ulEventStatus = AVR32_MACB.rsr;
   if( ulEventStatus & AVR32_MACB_BNA_MASK )
   {
-    AVR32_MACB.rsr =  AVR32_MACB_BNA_MASK;  // Clear
+    macbCLEAR_STATUS( AVR32_MACB.rsr, AVR32_MACB_BNA_MASK );  // Clear
     AVR32_MACB.rsr; // Read to force the previous write
-    if(ulMACBInputLength())
+    if(xMACBNextRxFrame(&xSpan))
       return true;
   }
 
@@ -983,6 +1730,74 @@ bool vMACBWaitForInput(unsigned long ulTimeOut)
 #endif
 }
 
+#if ETHERNET_CONF_RX_COALESCING
+void vMACBRxCoalesceTick(unsigned long ulElapsedMs)
+{
+  if( ulElapsedMs == 0 )
+  {
+    return;
+  }
+
+  if( !xRxPolling && ( ulRxCoalesceFrames > ETHERNET_CONF_RX_COALESCE_HIGH * ulElapsedMs ) )
+  {
+    // Too many frames: stop interrupting on each of them and poll instead.
+    AVR32_MACB.idr = AVR32_MACB_IDR_RCOMP_MASK;
+    xRxPolling = true;
+    ulRxCoalesceSwitches++;
+  }
+  else if( xRxPolling && ( ulRxCoalesceFrames <= ETHERNET_CONF_RX_COALESCE_LOW * ulElapsedMs ) )
+  {
+    // The load has dropped: back to one interrupt per frame.
+    AVR32_MACB.ier = AVR32_MACB_IER_RCOMP_MASK;
+    xRxPolling = false;
+    ulRxCoalesceSwitches++;
+    // Frames received while the interrupt was masked did not signal.
+    vMACBPostEvents( MACB_EVENT_RX );
+  }
+  ulRxCoalesceFrames = 0;
+
+  if( xRxPolling )
+  {
+    vMACBPostEvents( MACB_EVENT_RX );
+  }
+}
+
+bool xMACBRxPolling(void)
+{
+  return xRxPolling;
+}
+
+unsigned long ulMACBRxCoalesceSwitches(void)
+{
+  return ulRxCoalesceSwitches;
+}
+#endif
+
+#ifndef FREERTOS_USED
+unsigned long ulMACBTakeEvents(void)
+{
+  unsigned long ulEvents;
+
+  portENTER_CRITICAL();
+  ulEvents = ulMACBEvents;
+  ulMACBEvents = 0;
+  portEXIT_CRITICAL();
+  return ulEvents;
+}
+
+unsigned long ulMACBPendingEvents(void)
+{
+  return ulMACBEvents;
+}
+
+void vMACBPostEvents(unsigned long ulEvents)
+{
+  portENTER_CRITICAL();
+  ulMACBEvents |= ulEvents;
+  portEXIT_CRITICAL();
+}
+#endif
+
 
 /*
  * The MACB ISR.  Handles both Tx and Rx complete interrupts.
@@ -1040,20 +1855,46 @@ static long prvMACB_ISR_NonNakedBehaviour(void)
 #ifdef FREERTOS_USED
     xSemaphoreGiveFromISR( xSemaphore, &xSwitchRequired );
 #else
-    DataToRead++;
+    ulMACBEvents |= MACB_EVENT_RX;
 #endif
     portEXIT_CRITICAL();
-    AVR32_MACB.rsr =  AVR32_MACB_REC_MASK;  // Clear
+    macbCLEAR_STATUS( AVR32_MACB.rsr, AVR32_MACB_REC_MASK );  // Clear
     AVR32_MACB.rsr; // Read to force the previous write
   }
 
+  if( ulIntStatus & ( AVR32_MACB_ISR_TUND_MASK | AVR32_MACB_ISR_RLE_MASK ) )
+  {
+    // The transmitter has stopped on an underrun, or on a frame given up
+    // after too many collisions. Release the frames it marked as sent and
+    // resume with the first one left.
+    if( ulIntStatus & AVR32_MACB_ISR_TUND_MASK )
+    {
+      ulTxUnderruns++;
+    }
+    if( ulIntStatus & AVR32_MACB_ISR_RLE_MASK )
+    {
+      ulTxRetryLimits++;
+    }
+    prvStopTx(&AVR32_MACB);
+    prvStartTx(&AVR32_MACB);
+    macbCLEAR_STATUS( AVR32_MACB.tsr, AVR32_MACB_TSR_UND_MASK | AVR32_MACB_TSR_RLE_MASK | AVR32_MACB_TSR_BEX_MASK ); // Clear
+    AVR32_MACB.tsr; // Read to force the previous write
+#ifndef FREERTOS_USED
+    ulMACBEvents |= MACB_EVENT_TX;
+#endif
+  }
+
   if( ulIntStatus & AVR32_MACB_TCOMP_MASK )
   {
-    // A frame has been transmitted.  Mark all the buffers used by the
-    // frame just transmitted as free again.
+    // Frames have been transmitted.  Mark all the buffers used by the
+    // frames just transmitted as free again.
     vClearMACBTxBuffer();
-    AVR32_MACB.tsr =  AVR32_MACB_TSR_COMP_MASK; // Clear
+    macbCLEAR_STATUS( AVR32_MACB.tsr, AVR32_MACB_TSR_COMP_MASK ); // Clear
     AVR32_MACB.tsr; // Read to force the previous write
+#ifndef FREERTOS_USED
+    // Let the main loop release the frames sent.
+    ulMACBEvents |= MACB_EVENT_TX;
+#endif
   }
 
   return ( xSwitchRequired );
@@ -1105,6 +1946,12 @@ static long prvPHY_ISR_NonNakedBehaviour(void)
 	volatile unsigned long ulIntStatus, ulEventStatus;
 	long xSwitchRequired = false;
 	
+#if ETHERNET_CONF_PHY_ASYNC
+	// The PHY registers are read by xMACBPhyTask(), out of interrupt context.
+	xPhyEventPending = true;
+	( void )ulIntStatus;
+	( void )ulEventStatus;
+#else
 	// read Phy Interrupt register Status
 	ulIntStatus = ulReadMDIO(&AVR32_MACB, PHY_MISR);
 
@@ -1117,6 +1964,11 @@ static long prvPHY_ISR_NonNakedBehaviour(void)
 	{
 		prvSetupMACBConfig(&AVR32_MACB);
 	}
+#endif
+
+#ifndef FREERTOS_USED
+	ulMACBEvents |= MACB_EVENT_PHY;
+#endif
 
 #if EXTPHY_MACB_USE_EXTINT
 	eic_clear_interrupt_line(&AVR32_EIC, EXTPHY_MACB_INTERRUPT);
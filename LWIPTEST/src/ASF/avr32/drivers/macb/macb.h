@@ -67,11 +67,92 @@
 
 #include "conf_eth.h"
 
+/* Make sure ETHERNET_CONF_RX_ZERO_COPY is defined.
+ * If undefined set it to 0, which means frames are copied out of the Rx buffers.
+ */
+#ifndef ETHERNET_CONF_RX_ZERO_COPY
+# define ETHERNET_CONF_RX_ZERO_COPY 0
+#endif
+
+/* Make sure ETHERNET_CONF_TX_ZERO_COPY is defined.
+ * If undefined set it to 0, which means frames are copied into the Tx buffers.
+ */
+#ifndef ETHERNET_CONF_TX_ZERO_COPY
+# define ETHERNET_CONF_TX_ZERO_COPY 0
+#endif
+
+/* Make sure ETHERNET_CONF_PHY_ASYNC is defined.
+ * If undefined set it to 0, which means xMACBInit() waits for the PHY.
+ */
+#ifndef ETHERNET_CONF_PHY_ASYNC
+# define ETHERNET_CONF_PHY_ASYNC 0
+#endif
+
+#if ETHERNET_CONF_PHY_ASYNC
+#ifdef FREERTOS_USED
+# error ETHERNET_CONF_PHY_ASYNC is only supported by the stand-alone implementation
+#endif
+#ifndef ETHERNET_CONF_PHY_POLL_MS
+# define ETHERNET_CONF_PHY_POLL_MS 500
+#endif
+#endif
+
+/* Make sure ETHERNET_CONF_MDIO_QUEUE_LEN is defined.
+ * If undefined set it to 0, which means no deferred MDIO accesses.
+ */
+#ifndef ETHERNET_CONF_MDIO_QUEUE_LEN
+# define ETHERNET_CONF_MDIO_QUEUE_LEN 0
+#endif
+
+/* Make sure ETHERNET_CONF_PHY_HEALTH_MS is defined.
+ * If undefined set it to 0, which means no PHY health sampling.
+ */
+#ifndef ETHERNET_CONF_PHY_HEALTH_MS
+# define ETHERNET_CONF_PHY_HEALTH_MS 0
+#endif
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN && !ETHERNET_CONF_PHY_ASYNC
+# error ETHERNET_CONF_MDIO_QUEUE_LEN needs ETHERNET_CONF_PHY_ASYNC: the PHY ISR must not access the MDIO
+#endif
+
+#if ETHERNET_CONF_PHY_HEALTH_MS && ( ETHERNET_CONF_MDIO_QUEUE_LEN < 3 )
+# error ETHERNET_CONF_PHY_HEALTH_MS needs an ETHERNET_CONF_MDIO_QUEUE_LEN of at least 3
+#endif
+
+/* Make sure ETHERNET_CONF_RX_BROADCAST is defined.
+ * If undefined set it to 1, which means broadcast frames are received.
+ */
+#ifndef ETHERNET_CONF_RX_BROADCAST
+# define ETHERNET_CONF_RX_BROADCAST 1
+#endif
+
+/* Make sure ETHERNET_CONF_RX_COALESCING is defined.
+ * If undefined set it to 0, which means every received frame interrupts.
+ */
+#ifndef ETHERNET_CONF_RX_COALESCING
+# define ETHERNET_CONF_RX_COALESCING 0
+#endif
+
+#if ETHERNET_CONF_RX_COALESCING
+#ifdef FREERTOS_USED
+# error ETHERNET_CONF_RX_COALESCING is only supported by the stand-alone implementation
+#endif
+#ifndef ETHERNET_CONF_RX_COALESCE_HIGH
+# define ETHERNET_CONF_RX_COALESCE_HIGH 8
+#endif
+#ifndef ETHERNET_CONF_RX_COALESCE_LOW
+# define ETHERNET_CONF_RX_COALESCE_LOW  2
+#endif
+#endif
+
 //  These defines are missing from or wrong in the toolchain header file ip_xxx.h or part.h
 #ifndef AVR32_MACB_SPD_MASK
 #define AVR32_MACB_SPD_MASK                                 0x00000001
 #endif
 
+/*! Size of each MACB receive buffer. */
+#define MACB_RX_BUFFER_SIZE             128
+
 /*! \name Rx Ring descriptor flags
  */
 //! @{
@@ -220,6 +301,46 @@ typedef struct
 } macb_packet_t;
 //! @}
 
+/*! PHY bring-up states, see xMACBPhyTask().
+ */
+//! @{
+typedef enum
+{
+  MACB_PHY_RESET,       //!< Waiting for the end of the PHY software reset.
+  MACB_PHY_PROBE,       //!< Identifying the PHY and starting auto-negotiation.
+  MACB_PHY_LINK_DOWN,   //!< PHY set up, no link.
+  MACB_PHY_LINK_UP      //!< Link up, MACB speed and duplex set accordingly.
+} macb_phy_state_t;
+//! @}
+
+/*! Completion callback of a deferred MDIO access, called from the main loop
+ *  with the register and the value read (or written).
+ */
+typedef void (*macb_mdio_callback_t)(unsigned short usAddress, unsigned long ulValue, void *pvArg);
+
+/*! PHY health, sampled every ETHERNET_CONF_PHY_HEALTH_MS.
+ */
+//! @{
+typedef struct
+{
+  unsigned long ulSamples;        //!< Number of complete samples.
+  unsigned long ulPhyStatus;      //!< Last value of the PHY status register.
+  unsigned long ulRxErrors;       //!< Receive errors counted by the PHY.
+  unsigned long ulFalseCarriers;  //!< False carrier events counted by the PHY.
+} macb_phy_health_t;
+//! @}
+
+/*! Received frame: span of consecutive Rx buffers holding one frame.
+ */
+//! @{
+typedef struct
+{
+  unsigned long ulFirst;    //!< Index of the first Rx buffer of the frame.
+  unsigned long ulCount;    //!< Number of Rx buffers holding the frame.
+  unsigned long ulLength;   //!< Length of the frame in bytes.
+} macb_rx_span_t;
+//! @}
+
 /*! Receive Transfer descriptor structure.
  */
 //! @{
@@ -343,6 +464,21 @@ extern void vWriteMDIO(volatile avr32_macb_t *macb, unsigned short usAddress, un
  */
 extern bool xMACBInit(volatile avr32_macb_t *macb);
 
+#if ETHERNET_CONF_TX_ZERO_COPY
+/**
+ * \brief Send a frame made of ulCount data sections without copying them.
+ * Each section is pointed to by one MACB Tx descriptor, so the data must stay
+ * untouched until the frame has been sent (see ulMACBTxFramesSent()).
+ * This function is looping until enough Tx descriptors are free.
+ *
+ * \param *macb        Base address of the MACB
+ * \param *pxPackets   Sections of the frame, in order
+ * \param ulCount      Number of sections, at most ETHERNET_CONF_NB_TX_BUFFERS
+ *
+ * \return true if the frame was queued, false if it has too many sections.
+ */
+extern bool xMACBSendPackets(volatile avr32_macb_t *macb, const macb_packet_t *pxPackets, unsigned long ulCount);
+#else
 /**
  * \brief Send ulLength bytes from pcFrom. This copies the buffer to one of the
  * MACB Tx buffers, then indicates to the MACB that the buffer is ready.
@@ -357,24 +493,123 @@ extern bool xMACBInit(volatile avr32_macb_t *macb);
  * \return length sent.
  */
 extern unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigned long ulLength, long lEndOfFrame);
+#endif
 
 /**
- * \brief Frames can be read from the MACB in multiple sections.
- * Read ulSectionLength bytes from the MACB receive buffers to pcTo.
- * ulTotalFrameLength is the size of the entire frame.  Generally vMACBRead
- * will be repetedly called until the sum of all the ulSectionLenths totals
- * the value of ulTotalFrameLength.
+ * \brief Number of frames sent since the MACB was initialized. The counter is
+ * updated by the Tx interrupt and wraps around.
  *
- * \param *pvTo               Address of the buffer
- * \param ulSectionLength     Length of the buffer
- * \param ulTotalFrameLength  Length of the frame
+ * \return the number of frames sent.
  */
-extern void vMACBRead(void *pvTo, unsigned long ulSectionLength, unsigned long ulTotalFrameLength);
+extern unsigned long ulMACBTxFramesSent(void);
+
+/**
+ * \brief Number of Tx buffers that can be filled without waiting, starting
+ * with the buffer the next frame will be written to.
+ *
+ * \return the number of free Tx buffers.
+ */
+extern unsigned long ulMACBTxBuffersFree(void);
+
+/**
+ * \brief Number of times the transmitter stopped on an underrun, the DMA not
+ * feeding it fast enough. The frames not sent are sent again.
+ *
+ * \return the number of Tx underruns.
+ */
+extern unsigned long ulMACBTxUnderruns(void);
+
+/**
+ * \brief Number of times a frame could not be sent because of too many
+ * collisions (half duplex only).
+ *
+ * \return the number of Tx retry limit errors.
+ */
+extern unsigned long ulMACBTxRetryLimits(void);
+
+/**
+ * \brief Number of times the MACB speed or duplex mode was changed to follow
+ * the PHY, at init or after a renegotiation.
+ *
+ * \return the number of mode changes since init.
+ */
+extern unsigned long ulMACBLinkModeChanges(void);
+
+/**
+ * \brief Number of times the Rx ring was reset since the MACB was
+ * initialized. The ring is reset when the MACB runs out of Rx buffers (BNA),
+ * dropping the frames it held.
+ *
+ * \return the number of Rx ring resets.
+ */
+extern unsigned long ulMACBRxRingResets(void);
+
+/**
+ * \brief Look for the next complete frame in the Rx ring. The frame stays in
+ * the ring until the span is consumed, exactly once, by
+ * vMACBRxFrameRelease() (or vMACBRxFrameLend() in zero-copy mode); until then
+ * this function keeps returning the same frame.
+ *
+ * \param pxSpan  Output. Rx buffers holding the frame.
+ *
+ * \return true if a frame was found, false otherwise.
+ */
+extern bool xMACBNextRxFrame(macb_rx_span_t *pxSpan);
+
+/**
+ * \brief Copy part of a received frame. The frame can be read in any number
+ * of sections, in any order: no read position is kept between calls.
+ *
+ * \param pxSpan    Frame returned by xMACBNextRxFrame()
+ * \param ulOffset  Offset of the first byte to copy in the frame
+ * \param pvTo      Address of the destination buffer
+ * \param ulLength  Number of bytes to copy
+ *
+ * \return the number of bytes copied, less than ulLength at the end of the frame.
+ */
+extern unsigned long ulMACBRxFrameCopy(const macb_rx_span_t *pxSpan, unsigned long ulOffset, void *pvTo, unsigned long ulLength);
+
+/**
+ * \brief Give the Rx buffers of a frame back to the MACB and move on to the
+ * next frame.
+ *
+ * \param pxSpan  Frame returned by xMACBNextRxFrame()
+ */
+extern void vMACBRxFrameRelease(const macb_rx_span_t *pxSpan);
+
+#if ETHERNET_CONF_RX_ZERO_COPY
+/**
+ * \brief Get one of the Rx buffers of a frame, to use it in place.
+ *
+ * \param pxSpan     Frame returned by xMACBNextRxFrame()
+ * \param ulBuffer   Rank of the buffer in the frame, below pxSpan->ulCount
+ * \param ppvBuffer  Output. Address of the buffer.
+ *
+ * \return the index of the buffer in the Rx ring.
+ */
+extern unsigned long ulMACBRxFrameBuffer(const macb_rx_span_t *pxSpan, unsigned long ulBuffer, void **ppvBuffer);
+
+/**
+ * \brief Hand the Rx buffers of a frame over to the caller instead of giving
+ * them back to the MACB, and move on to the next frame. Each buffer stays out
+ * of the MACB ring until vMACBReturnRxBuffer() is called with its index.
+ *
+ * \param pxSpan  Frame returned by xMACBNextRxFrame()
+ */
+extern void vMACBRxFrameLend(const macb_rx_span_t *pxSpan);
+
+/**
+ * \brief Give a buffer lent by vMACBRxFrameLend() back to the MACB.
+ *
+ * \param ulIndex  Index of the buffer in the Rx ring.
+ */
+extern void vMACBReturnRxBuffer(unsigned long ulIndex);
+#endif
 
 /**
  * \brief Called by the Tx interrupt, this function traverses the buffers used to
- * hold the frame that has just completed transmission and marks each as
- * free again.
+ * hold the frames that have completed transmission and marks each as
+ * free again. Only the buffers of these frames are touched.
  */
 extern void vClearMACBTxBuffer(void);
 
@@ -385,7 +620,7 @@ extern void vClearMACBTxBuffer(void);
  * semaphore to be obtained or a timeout. The semaphore is used by the MACB ISR
  * to indicate that data has been received and is ready for processing.
  *
- * - Stand-alone implementation: Check, until timeout, a local variable updated
+ * - Stand-alone implementation: Check, until timeout, the MACB_EVENT_RX flag set
  * by the MACB ISR upon data reception.
  *
  * \param ulTimeOut    time to wait for an input
@@ -393,12 +628,69 @@ extern void vClearMACBTxBuffer(void);
  * \return true if success, false otherwise.
  */
 extern bool vMACBWaitForInput(unsigned long ulTimeOut);
+
+#ifndef FREERTOS_USED
+/*! \name Pending work flags set by the MACB and PHY interrupts (stand-alone
+ *  implementation).
+ */
+//! @{
+#define MACB_EVENT_RX             0x00000001  //!< A frame has been received.
+#define MACB_EVENT_TX             0x00000002  //!< A frame has been transmitted.
+#define MACB_EVENT_PHY            0x00000004  //!< The PHY status has changed.
+//! @}
+
+/**
+ * \brief Get and clear the pending work flags. The main loop can sleep
+ * until an interrupt sets a flag, then serve the flags returned here.
+ *
+ * \return the MACB_EVENT_xxx flags set since the previous call.
+ */
+extern unsigned long ulMACBTakeEvents(void);
+
+/**
+ * \brief Get the pending work flags without clearing them.
+ *
+ * \return the MACB_EVENT_xxx flags currently set.
+ */
+extern unsigned long ulMACBPendingEvents(void);
+
+/**
+ * \brief Set pending work flags, e.g. when the main loop left received
+ * frames in the Rx ring and must not sleep.
+ *
+ * \param ulEvents  MACB_EVENT_xxx flags to set.
+ */
+extern void vMACBPostEvents(unsigned long ulEvents);
+#endif
+
+#if ETHERNET_CONF_RX_COALESCING
 /**
- * \brief Function to get length of the next frame in the receive buffers
+ * \brief Adapt the Rx interrupt to the load. Must be called periodically
+ * (typically every ms) from the main loop.
+ * Once more than ETHERNET_CONF_RX_COALESCE_HIGH frames per ms have been read,
+ * the Rx complete interrupt is masked and the Rx ring is polled: every call
+ * then posts MACB_EVENT_RX. The interrupt is unmasked when the load falls to
+ * ETHERNET_CONF_RX_COALESCE_LOW frames per ms or less.
+ *
+ * \param ulElapsedMs  Time in ms since the previous call.
+ */
+extern void vMACBRxCoalesceTick(unsigned long ulElapsedMs);
+
+/**
+ * \brief Tell whether the Rx ring is currently polled.
  *
- * \return the length of the next frame in the receive buffers.
+ * \return true if the Rx complete interrupt is masked, false otherwise.
  */
-extern unsigned long ulMACBInputLength(void);
+extern bool xMACBRxPolling(void);
+
+/**
+ * \brief Number of switches between interrupt and polling mode since the
+ * MACB was initialized.
+ *
+ * \return the number of mode switches.
+ */
+extern unsigned long ulMACBRxCoalesceSwitches(void);
+#endif
 
 /**
  * \brief Set the MACB Physical address (SA1B & SA1T registers).
@@ -407,6 +699,98 @@ extern unsigned long ulMACBInputLength(void);
  */
 extern void vMACBSetMACAddress(const unsigned char *MACAddress);
 
+#if ETHERNET_CONF_PHY_ASYNC
+/**
+ * \brief Bring the PHY up and follow the link, without waiting for it.
+ * xMACBInit() only starts the PHY reset; this function must then be called
+ * from the main loop to go through the macb_phy_state_t states, a few MDIO
+ * accesses at a time. Once the PHY is set up, the link is checked on each
+ * PHY interrupt and every ETHERNET_CONF_PHY_POLL_MS.
+ *
+ * \param ulNow  Current time in ms.
+ *
+ * \return true if the link is up, false otherwise.
+ */
+extern bool xMACBPhyTask(unsigned long ulNow);
+
+/**
+ * \brief Get the PHY bring-up state.
+ *
+ * \return the current macb_phy_state_t state.
+ */
+extern macb_phy_state_t eMACBPhyState(void);
+#endif
+
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+/**
+ * \brief Queue a PHY register read, done later by vMACBMdioTask().
+ *
+ * \param usAddress    Input. register to read.
+ * \param pxCallback   Input. called with the value read, may be NULL.
+ * \param pvArg        Input. passed to pxCallback.
+ *
+ * \return false if the queue is full.
+ */
+extern bool xMACBMdioRead(unsigned short usAddress, macb_mdio_callback_t pxCallback, void *pvArg);
+
+/**
+ * \brief Queue a PHY register write, done later by vMACBMdioTask().
+ *
+ * \param usAddress    Input. register to set.
+ * \param usValue      Input. value to write.
+ * \param pxCallback   Input. called once written, may be NULL.
+ * \param pvArg        Input. passed to pxCallback.
+ *
+ * \return false if the queue is full.
+ */
+extern bool xMACBMdioWrite(unsigned short usAddress, unsigned short usValue, macb_mdio_callback_t pxCallback, void *pvArg);
+
+/**
+ * \brief Service the deferred MDIO accesses, without waiting: complete the
+ * access in progress if the management port is idle, calling its callback,
+ * then start the next one. Must be called from the main loop.
+ * A synchronous ulReadMDIO()/vWriteMDIO() first completes the access in
+ * progress, so the callbacks may also run from there.
+ */
+extern void vMACBMdioTask(void);
+#endif
+
+#if ETHERNET_CONF_PHY_HEALTH_MS
+/**
+ * \brief Queue the reads of the PHY status and error counters every
+ * ETHERNET_CONF_PHY_HEALTH_MS. The results are gathered as the reads
+ * complete in vMACBMdioTask().
+ *
+ * \param ulNow  Current time in ms.
+ */
+extern void vMACBPhyHealthTask(unsigned long ulNow);
+
+/**
+ * \brief Get the PHY health sampled so far.
+ *
+ * \param pxHealth  Output. copy of the PHY health.
+ */
+extern void vMACBGetPhyHealth(macb_phy_health_t *pxHealth);
+#endif
+
+/**
+ * \brief Accept the multicast frames sent to an address. The MACB only
+ * receives the multicast addresses added here, through its 64-bit hash filter
+ * (HRB & HRT registers). The filter is imperfect: addresses sharing a hash
+ * bit with an added one are received too.
+ *
+ * \param pucAddress  the 6-byte multicast MAC address.
+ */
+extern void vMACBHashAdd(const unsigned char *pucAddress);
+
+/**
+ * \brief Stop accepting the multicast frames sent to an address added by
+ * vMACBHashAdd(). Each call cancels one call to vMACBHashAdd().
+ *
+ * \param pucAddress  the 6-byte multicast MAC address.
+ */
+extern void vMACBHashRemove(const unsigned char *pucAddress);
+
 /**
  * \brief Disable MACB operations (Tx and Rx).
  *
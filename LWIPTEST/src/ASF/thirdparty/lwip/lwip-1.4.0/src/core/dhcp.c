@@ -611,24 +611,19 @@ void dhcp_cleanup(struct netif *netif)
 }
 
 /**
- * Start DHCP negotiation for a network interface.
- *
- * If no DHCP client instance was attached to this interface,
- * a new client is created first. If a DHCP client instance
- * was already present, it restarts negotiation.
+ * Attach a DHCP client to a network interface, or reset the one attached,
+ * ready to send its first message.
  *
  * @param netif The lwIP network interface
  * @return lwIP error code
  * - ERR_OK - No error
  * - ERR_MEM - Out of memory
  */
-err_t
-dhcp_start(struct netif *netif)
+static err_t
+dhcp_start_client(struct netif *netif)
 {
   struct dhcp *dhcp;
-  err_t result = ERR_OK;
 
-  LWIP_ERROR("netif != NULL", (netif != NULL), return ERR_ARG;);
   dhcp = netif->dhcp;
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("dhcp_start(netif=%p) %c%c%"U16_F"\n", (void*)netif, netif->name[0], netif->name[1], (u16_t)netif->num));
   /* Remove the flag that says this netif is handled by DHCP,
@@ -683,6 +678,31 @@ dhcp_start(struct netif *netif)
   udp_connect(dhcp->pcb, IP_ADDR_ANY, DHCP_SERVER_PORT);
   /* set up the recv callback and argument */
   udp_recv(dhcp->pcb, dhcp_recv, netif);
+  return ERR_OK;
+}
+
+/**
+ * Start DHCP negotiation for a network interface.
+ *
+ * If no DHCP client instance was attached to this interface,
+ * a new client is created first. If a DHCP client instance
+ * was already present, it restarts negotiation.
+ *
+ * @param netif The lwIP network interface
+ * @return lwIP error code
+ * - ERR_OK - No error
+ * - ERR_MEM - Out of memory
+ */
+err_t
+dhcp_start(struct netif *netif)
+{
+  err_t result;
+
+  LWIP_ERROR("netif != NULL", (netif != NULL), return ERR_ARG;);
+  result = dhcp_start_client(netif);
+  if (result != ERR_OK) {
+    return result;
+  }
   LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("dhcp_start(): starting DHCP configuration\n"));
   /* (re)start the DHCP negotiation */
   result = dhcp_discover(netif);
@@ -696,6 +716,43 @@ dhcp_start(struct netif *netif)
   return result;
 }
 
+/**
+ * Start DHCP for a network interface in the INIT-REBOOT state (RFC 2131,
+ * 3.2): a single REQUEST for an address leased before, instead of a
+ * DISCOVER. A NAK, or no answer, sends the client back to DISCOVER.
+ *
+ * Not in lwIP 1.4.0: added for the board, to confirm a cached lease.
+ *
+ * @param netif The lwIP network interface
+ * @param addr The address leased before
+ * @return lwIP error code
+ * - ERR_OK - No error
+ * - ERR_MEM - Out of memory
+ */
+err_t
+dhcp_start_reboot(struct netif *netif, ip_addr_t *addr)
+{
+  err_t result;
+
+  LWIP_ERROR("netif != NULL", (netif != NULL), return ERR_ARG;);
+  LWIP_ERROR("addr != NULL", (addr != NULL), return ERR_ARG;);
+  result = dhcp_start_client(netif);
+  if (result != ERR_OK) {
+    return result;
+  }
+  LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("dhcp_start_reboot(): requesting the previous address\n"));
+  ip_addr_copy(netif->dhcp->offered_ip_addr, *addr);
+  result = dhcp_reboot(netif);
+  if (result != ERR_OK) {
+    /* free resources allocated above */
+    dhcp_stop(netif);
+    return ERR_MEM;
+  }
+  /* Set the flag that says this netif is handled by DHCP. */
+  netif->flags |= NETIF_FLAG_DHCP;
+  return result;
+}
+
 /**
  * Inform a DHCP server of our manual configuration.
  *
@@ -44,6 +44,75 @@
 
 
 
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+
+/** Number of bins of the frames-per-poll histogram: bin i counts the polls
+ * that received i frames, the last bin those that received more. */
+#define ETHERNETIF_RX_HIST_BINS   9
+
+#if LINK_STATS
+/** Port layer counters, completing the lwIP link statistics. */
+struct ethernetif_stats {
+  u32_t tx_queued;      /* frames deferred to the Tx queue */
+  u32_t tx_queue_full;  /* frames refused because the Tx queue was full */
+  u32_t tx_queue_max;   /* highest number of frames held by the Tx queue */
+  u32_t rx_ring_resets; /* Rx ring resets after a BNA, see ulMACBRxRingResets() */
+  u32_t rx_frames_per_poll[ETHERNETIF_RX_HIST_BINS]; /* ethernetif_input_burst() histogram */
+  u32_t rx_filtered;    /* frames dropped by the Rx prefilter */
+  u32_t tx_underruns;   /* MACB Tx underruns */
+  u32_t tx_retry_limits; /* MACB Tx retry limit errors */
+  u32_t rx_held_copies; /* zero-copy Rx buffers held by lwIP, moved to a copy */
+  u32_t rx_held_nomem;  /* zero-copy Rx buffers held by lwIP, left lent for lack of heap */
+  u32_t rx_pool_copies; /* zero-copy Rx frames copied for lack of custom pbufs */
+};
+
+extern struct ethernetif_stats ethernetif_stats;
+
+#define ETHERNETIF_STATS_INC(x) ++ethernetif_stats.x
+#else
+#define ETHERNETIF_STATS_INC(x)
+#endif
+
+/** Number of bytes at the start of each received frame given to the Rx
+ * prefilter: Ethernet header, IPv4 header with options and UDP ports. */
+#define ETHERNETIF_RX_PEEK_LEN    80
+
+/**
+ * Rx prefilter, called for each received frame while it is still in the MACB
+ * buffers, before any pbuf is allocated for it.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param frame the first bytes of the frame, Ethernet header included
+ * @param len number of bytes in frame, at most ETHERNETIF_RX_PEEK_LEN
+ * @return 1 to pass the frame to lwIP, 0 to drop it
+ */
+typedef u8_t (*ethernetif_rx_filter_fn)(struct netif *netif, const u8_t *frame, u16_t len);
+
+/**
+ * Install the Rx prefilter (NULL to pass all frames to lwIP).
+ *
+ * @param filter the new prefilter
+ */
+void ethernetif_set_rx_filter(ethernetif_rx_filter_fn filter);
+
+/**
+ * Default Rx prefilter: passes ARP and the IPv4 frames lwIP can use, i.e.
+ * sent to our address (any address while it is not configured), to a
+ * broadcast or to a multicast address, and for UDP to a port bound by a
+ * udp_pcb. Other ethertypes (IPv6, LLDP, STP...) are dropped.
+ */
+u8_t ethernetif_default_rx_filter(struct netif *netif, const u8_t *frame, u16_t len);
+
+/**
+ * Hand the frames waiting in the Tx queue to the MACB, as far as the Tx
+ * descriptors allow, and release the frames the MACB has sent.
+ * Should be called regularly from the main loop.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ */
+void ethernetif_output_flush(struct netif *netif);
+
 #ifndef FREERTOS_USED
 /**
  * This function should be called when a packet is ready to be read
@@ -55,5 +124,25 @@
  * @param netif the lwip network interface structure for this ethernetif
  */
 void ethernetif_input(void * pvParameters);
+
+/**
+ * Read up to budget frames from the interface and pass them to lwIP, so a
+ * burst of frames is drained in one call instead of one frame per call.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param budget maximum number of frames to process
+ * @return the number of frames read
+ */
+u32_t ethernetif_input_burst(struct netif *netif, u32_t budget);
 #endif
 
+/**
+ * Advance the PHY bring-up and report link changes to lwIP with
+ * netif_set_link_up()/netif_set_link_down(). Only does something when
+ * ETHERNET_CONF_PHY_ASYNC is set; should be called from the main loop.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param now current time in ms
+ */
+void ethernetif_link_task(struct netif *netif, u32_t now);
+
@@ -42,6 +42,8 @@
  *
  *****************************************************************************/
 
+#include <string.h>
+
 #include "lwip/opt.h"
 
 #include "lwip/def.h"
@@ -52,13 +54,20 @@
 #include <lwip/snmp.h>
 #include "netif/etharp.h"
 #include "netif/ppp_oe.h"
+#if LWIP_IGMP
+#include "lwip/igmp.h"
+#endif
+#if LWIP_UDP
+#include "lwip/udp.h"
+#endif
+#if LWIP_DHCP
+#include "lwip/dhcp.h"
+#endif
 
 #include "conf_eth.h"
 #include "macb.h"
 
-#ifndef FREERTOS_USED
 #include "netif/ethernetif.h"
-#endif
 
 
 /* Define those to better describe your network interface. */
@@ -69,6 +78,21 @@
 #define netifGUARD_BLOCK_NBTICKS       ( 250 )
 #endif
 
+/* Number of frames low_level_output() may queue while the Tx ring is full.
+0 keeps low_level_output() waiting for free Tx buffers. */
+#ifndef ETHERNET_CONF_TX_QUEUE_LEN
+#define ETHERNET_CONF_TX_QUEUE_LEN     0
+#endif
+
+/* Set to 1 to install ethernetif_default_rx_filter() at startup. */
+#ifndef ETHERNET_CONF_RX_PREFILTER
+#define ETHERNET_CONF_RX_PREFILTER     0
+#endif
+
+#if ETHERNET_CONF_TX_QUEUE_LEN && defined(FREERTOS_USED)
+#error ETHERNET_CONF_TX_QUEUE_LEN requires ethernetif_output_flush() to be called from the main loop
+#endif
+
 //The MAC address from MAC driver
 extern unsigned char cMACAddress[ 6 ];
 
@@ -88,6 +112,246 @@ struct ethernetif {
 static void  ethernetif_input(void * );
 #endif
 
+#if LINK_STATS
+struct ethernetif_stats ethernetif_stats;
+#endif
+
+/* Rx prefilter, see ethernetif_set_rx_filter(). */
+#if ETHERNET_CONF_RX_PREFILTER
+static ethernetif_rx_filter_fn rx_filter = ethernetif_default_rx_filter;
+#else
+static ethernetif_rx_filter_fn rx_filter = NULL;
+#endif
+
+#if ETHERNET_CONF_RX_ZERO_COPY
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error ETHERNET_CONF_RX_ZERO_COPY requires LWIP_SUPPORT_CUSTOM_PBUF
+#endif
+#if ETH_PAD_SIZE
+#error ETHERNET_CONF_RX_ZERO_COPY does not support ETH_PAD_SIZE
+#endif
+#ifdef FREERTOS_USED
+#error ETHERNET_CONF_RX_ZERO_COPY requires the stand-alone implementation (netif->input must process the frame before it returns)
+#endif
+
+/* Number of custom pbufs: one per Rx buffer lent to lwIP, the others for the
+pbufs lwIP holds on to once they are moved to a copy of their buffer. Frames
+received while too few are left are copied into PBUF_POOL pbufs. */
+#ifndef ETHERNETIF_RX_CUSTOM_PBUFS
+#define ETHERNETIF_RX_CUSTOM_PBUFS     ( 2 * ETHERNET_CONF_NB_RX_BUFFERS )
+#endif
+
+/* Custom pbuf wrapping a MACB Rx buffer while it is lent to lwIP, or a copy
+of the buffer once lwIP has held on to it. */
+struct rx_pbuf {
+  struct pbuf_custom      pc;
+  struct rx_pbuf          *next;      /* next free custom pbuf */
+  unsigned long           ulIndex;    /* index of the buffer in the Rx ring */
+  u8_t                    *pucBuffer; /* the MACB buffer */
+  u8_t                    *pucCopy;   /* its copy, NULL while the buffer is lent */
+};
+
+static struct rx_pbuf xRxPbufs[ ETHERNETIF_RX_CUSTOM_PBUFS ];
+static struct rx_pbuf *pxRxPbufsFree = NULL;
+static unsigned long ulRxPbufsFree = 0;
+
+/**
+ * Called by pbuf_free() when lwIP is done with a received buffer: give it
+ * back to the MACB, or free its copy.
+ *
+ * @param p the pbuf being freed, embedded in one of xRxPbufs[]
+ */
+static void
+rx_pbuf_free(struct pbuf *p)
+{
+  struct rx_pbuf          *pxRx = ( struct rx_pbuf * )p;
+
+  if( pxRx->pucCopy != NULL )
+  {
+    mem_free( pxRx->pucCopy );
+    pxRx->pucCopy = NULL;
+  }
+  else
+  {
+    vMACBReturnRxBuffer( pxRx->ulIndex );
+  }
+  pxRx->next = pxRxPbufsFree;
+  pxRxPbufsFree = pxRx;
+  ulRxPbufsFree++;
+}
+
+/**
+ * Put all the custom pbufs in the free list.
+ */
+static void
+rx_pbufs_init(void)
+{
+  unsigned long           ulIndex;
+
+  pxRxPbufsFree = NULL;
+  for( ulIndex = 0; ulIndex < ETHERNETIF_RX_CUSTOM_PBUFS; ulIndex++ )
+  {
+    xRxPbufs[ ulIndex ].pc.custom_free_function = rx_pbuf_free;
+    xRxPbufs[ ulIndex ].pucCopy = NULL;
+    xRxPbufs[ ulIndex ].next = pxRxPbufsFree;
+    pxRxPbufsFree = &xRxPbufs[ ulIndex ];
+  }
+  ulRxPbufsFree = ETHERNETIF_RX_CUSTOM_PBUFS;
+}
+
+/**
+ * Tell whether a pbuf still points into a MACB Rx buffer.
+ *
+ * @param p the pbuf
+ * @return 1 if the pbuf wraps a lent Rx buffer, 0 otherwise
+ */
+static u8_t
+rx_pbuf_lent(struct pbuf *p)
+{
+  return ( p->flags & PBUF_FLAG_IS_CUSTOM )
+      && ( ( ( struct pbuf_custom * )p )->custom_free_function == rx_pbuf_free )
+      && ( ( ( struct rx_pbuf * )p )->pucCopy == NULL );
+}
+
+#if ETHERNET_CONF_TX_ZERO_COPY
+/**
+ * Tell whether a frame points into MACB Rx buffers, e.g. an ARP reply built
+ * in the received request.
+ *
+ * @param p the frame
+ * @return 1 if one of the pbufs wraps a lent Rx buffer, 0 otherwise
+ */
+static u8_t
+rx_frame_lent(struct pbuf *p)
+{
+  for( ; p != NULL; p = p->next )
+  {
+    if( rx_pbuf_lent( p ) )
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+/**
+ * Move the pbufs of a frame lwIP holds on to (TCP out-of-sequence segment,
+ * IP fragment, data refused by the application...) to copies of their Rx
+ * buffers, and give the buffers back to the MACB. The MACB stops at the first
+ * buffer it doesn't own: a buffer left lent would stop the reception.
+ *
+ * @param p the frame
+ */
+static void
+rx_frame_unlend(struct pbuf *p)
+{
+  struct rx_pbuf          *pxRx;
+  u8_t                    *pucCopy;
+
+  for( ; p != NULL; p = p->next )
+  {
+    if( !rx_pbuf_lent( p ) )
+    {
+      continue;
+    }
+    pxRx = ( struct rx_pbuf * )p;
+    pucCopy = ( u8_t * )mem_malloc( MACB_RX_BUFFER_SIZE );
+    if( pucCopy == NULL )
+    {
+      /* The buffer stays lent until lwIP frees the pbuf. */
+      ETHERNETIF_STATS_INC(rx_held_nomem);
+      continue;
+    }
+    /* lwIP may have moved the payload past headers within the buffer. */
+    MEMCPY( pucCopy, pxRx->pucBuffer, MACB_RX_BUFFER_SIZE );
+    p->payload = pucCopy + ( ( u8_t * )p->payload - pxRx->pucBuffer );
+    pxRx->pucCopy = pucCopy;
+    vMACBReturnRxBuffer( pxRx->ulIndex );
+    ETHERNETIF_STATS_INC(rx_held_copies);
+  }
+}
+#else
+#define rx_frame_lent( p )             0
+#endif
+
+#if ETHERNET_CONF_TX_ZERO_COPY
+#if ETH_PAD_SIZE
+#error ETHERNET_CONF_TX_ZERO_COPY does not support ETH_PAD_SIZE
+#endif
+
+/* Frames handed to the MACB without copy, in transmission order. Each one
+holds a reference on its pbuf until the MACB has sent it. */
+static struct pbuf *pxTxFrames[ ETHERNET_CONF_NB_TX_BUFFERS + 1 ];
+static unsigned long ulTxFramesHead = 0, ulTxFramesTail = 0;
+
+/* Number of frames released so far, compared with ulMACBTxFramesSent(). */
+static unsigned long ulTxFramesReleased = 0;
+
+/**
+ * Free the pbufs of the frames the MACB has finished sending.
+ * The Tx interrupt only counts sent frames: pbufs are freed here, outside
+ * interrupt context, as lwIP must not be entered from an ISR.
+ */
+static void
+tx_frames_release(void)
+{
+  unsigned long ulSent = ulMACBTxFramesSent();
+
+  while( ( ulTxFramesReleased != ulSent ) && ( ulTxFramesTail != ulTxFramesHead ) )
+  {
+    pbuf_free( pxTxFrames[ ulTxFramesTail ] );
+    if( ++ulTxFramesTail > ETHERNET_CONF_NB_TX_BUFFERS )
+    {
+      ulTxFramesTail = 0;
+    }
+    ulTxFramesReleased++;
+  }
+}
+#endif
+
+#if ETHERNET_CONF_TX_QUEUE_LEN
+/* Frames waiting for free Tx buffers, in transmission order. Each one holds
+a reference on its pbuf until it is handed to the MACB. */
+static struct pbuf *pxTxQueue[ ETHERNET_CONF_TX_QUEUE_LEN ];
+static unsigned long ulTxQueueHead = 0, ulTxQueueTail = 0, ulTxQueueCount = 0;
+
+/**
+ * Number of Tx buffers low_level_send() will use for a frame.
+ *
+ * @param p the MAC packet to send
+ * @return the number of Tx buffers, at most the size of the Tx ring
+ */
+static unsigned long
+tx_buffers_needed(struct pbuf *p)
+{
+  struct pbuf             *q;
+  unsigned long           ulNeeded = 0;
+
+#if ETHERNET_CONF_TX_ZERO_COPY
+  if( ( pbuf_clen( p ) > ETHERNET_CONF_NB_TX_BUFFERS ) || rx_frame_lent( p ) )
+  {
+    /* Sent from a flat copy. */
+    return 1;
+  }
+  for( q = p; q != NULL; q = q->next )
+  {
+    if( q->len != 0 )
+    {
+      ulNeeded++;
+    }
+  }
+#else
+  for( q = p; q != NULL; q = q->next )
+  {
+    ulNeeded += ( q->len + ETHERNET_CONF_TX_BUFFER_SIZE - 1 ) / ETHERNET_CONF_TX_BUFFER_SIZE;
+  }
+#endif
+
+  return ( ulNeeded > ETHERNET_CONF_NB_TX_BUFFERS ) ? ETHERNET_CONF_NB_TX_BUFFERS : ulNeeded;
+}
+#endif
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -122,10 +386,20 @@ low_level_init(struct netif *netif)
   netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP
 #if defined(DHCP_USED)
     | NETIF_FLAG_DHCP
+#endif
+#if LWIP_IGMP
+    | NETIF_FLAG_IGMP
+#endif
+#if !ETHERNET_CONF_PHY_ASYNC
+    /* xMACBInit() has waited for the PHY */
+    | NETIF_FLAG_LINK_UP
 #endif
   ;
 
   /* Do whatever else is needed to initialize interface. */
+#if ETHERNET_CONF_RX_ZERO_COPY
+  rx_pbufs_init();
+#endif
   /* Initialise the MACB. */
 #ifdef FREERTOS_USED
   // NOTE: This routine contains code that polls status bits. If the Ethernet
@@ -154,14 +428,174 @@ low_level_init(struct netif *netif)
 #endif
 }
 
+#if LWIP_IGMP
+/**
+ * Add or remove a multicast group from the MACB hash filter. Called by lwIP
+ * when a group is joined or left: the MACB only receives the multicast
+ * frames of the joined groups.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param group the IPv4 multicast group
+ * @param action IGMP_ADD_MAC_FILTER or IGMP_DEL_MAC_FILTER
+ * @return ERR_OK
+ */
+static err_t
+low_level_igmp_mac_filter(struct netif *netif, ip_addr_t *group, u8_t action)
+{
+  u8_t                    mac[ ETHARP_HWADDR_LEN ];
+  u32_t                   addr = ntohl( ip4_addr_get_u32( group ) );
+
+  ( void )netif; // Unused param, avoid a compiler warning.
+
+  /* 01:00:5e followed by the low 23 bits of the group (RFC 1112). */
+  mac[0] = 0x01;
+  mac[1] = 0x00;
+  mac[2] = 0x5e;
+  mac[3] = ( addr >> 16 ) & 0x7f;
+  mac[4] = ( addr >> 8 ) & 0xff;
+  mac[5] = addr & 0xff;
+
+  if( action == IGMP_ADD_MAC_FILTER )
+  {
+    vMACBHashAdd( mac );
+  }
+  else
+  {
+    vMACBHashRemove( mac );
+  }
+
+  return ERR_OK;
+}
+#endif
+
+/**
+ * Hand a frame to the MACB. Waits for free Tx buffers when the Tx ring is
+ * full.
+ *
+ * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
+ * @return ERR_OK if the packet was handed to the MACB
+ *         ERR_MEM if the packet couldn't be sent
+ *         ERR_IF if the MACB refused the packet
+ */
+static err_t
+low_level_send(struct pbuf *p)
+{
+  struct pbuf             *q;
+#if ETHERNET_CONF_TX_ZERO_COPY
+  struct pbuf             *pxFrame;
+  macb_packet_t           xPackets[ ETHERNET_CONF_NB_TX_BUFFERS ];
+  unsigned long           ulCount;
+#endif
+  err_t                   xErr = ERR_OK;
+
+
+#if ETH_PAD_SIZE
+  pbuf_header( p, -ETH_PAD_SIZE );    /* drop the padding word */
+#endif
+
+#if ETHERNET_CONF_TX_ZERO_COPY
+  /* Free what the MACB is done with before queuing more. */
+  tx_frames_release();
+
+  if( ( pbuf_clen( p ) > ETHERNET_CONF_NB_TX_BUFFERS ) || rx_frame_lent( p ) )
+  {
+    /* A chain longer than the Tx ring is sent from a flat copy. So is a
+    frame in MACB Rx buffers: they return to the MACB once the received frame
+    is processed, possibly before the frame is sent. */
+    pxFrame = pbuf_alloc( PBUF_RAW, p->tot_len, PBUF_RAM );
+    if( pxFrame != NULL )
+    {
+      pbuf_copy( pxFrame, p );
+    }
+  }
+  else
+  {
+    /* The frame stays referenced until tx_frames_release() sees it sent. */
+    pxFrame = p;
+    pbuf_ref( pxFrame );
+  }
+
+  if( pxFrame != NULL )
+  {
+    /* Point one Tx descriptor at the payload of each pbuf. */
+    ulCount = 0;
+    for( q = pxFrame; q != NULL; q = q->next )
+    {
+      if( q->len != 0 )
+      {
+        xPackets[ ulCount ].data = q->payload;
+        xPackets[ ulCount ].len = q->len;
+        ulCount++;
+      }
+    }
+    if( xMACBSendPackets( &AVR32_MACB, xPackets, ulCount ) )
+    {
+      tx_frames_release();
+      pxTxFrames[ ulTxFramesHead ] = pxFrame;
+      if( ++ulTxFramesHead > ETHERNET_CONF_NB_TX_BUFFERS )
+      {
+        ulTxFramesHead = 0;
+      }
+    }
+    else
+    {
+      /* Nothing was queued (empty frame): the MACB will never report it
+      sent, so it must not enter the Tx frame FIFO. */
+      pbuf_free( pxFrame );
+      xErr = ERR_IF;
+    }
+  }
+  else
+  {
+    xErr = ERR_MEM;
+  }
+#else
+  for( q = p; q != NULL; q = q->next )
+  {
+    /* Send the data from the pbuf to the interface, one pbuf at a time. The
+    size of the data in each pbuf is kept in the ->len variable.
+    This function also signals to the MACB that the packet should be sent. */
+    lMACBSend(&AVR32_MACB, q->payload, q->len, ( q->next == NULL ) );
+  }
+#endif
+
+#if ETH_PAD_SIZE
+  pbuf_header( p, ETH_PAD_SIZE );     /* reclaim the padding word */
+#endif
+
+  if( xErr == ERR_OK )
+  {
+    LINK_STATS_INC(link.xmit);  // Traces
+  }
+  else
+  {
+    if( xErr == ERR_MEM )
+    {
+      LINK_STATS_INC(link.memerr);
+    }
+    else
+    {
+      LINK_STATS_INC(link.err);
+    }
+    LINK_STATS_INC(link.drop);
+  }
+
+  return xErr;
+}
+
 /**
  * This function should do the actual transmission of the packet. The packet is
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * With ETHERNET_CONF_TX_QUEUE_LEN set, a packet that doesn't fit in the free
+ * Tx buffers is queued and sent later by ethernetif_output_flush(), so this
+ * function never waits for the MACB.
+ *
  * @param netif the lwip network interface structure for this ethernetif
  * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
- * @return ERR_OK if the packet could be sent
+ * @return ERR_OK if the packet could be sent or queued
+ *         ERR_WOULDBLOCK if the Tx ring and the Tx queue are full
  *         an err_t value if the packet couldn't be sent
  *
  * @note Returning ERR_MEM here if a DMA queue of your MAC is full can lead to
@@ -173,7 +607,7 @@ low_level_init(struct netif *netif)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf             *q;
+  err_t                   xErr = ERR_OK;
 #ifdef FREERTOS_USED
   static xSemaphoreHandle xTxSemaphore = NULL;
 #endif
@@ -186,36 +620,168 @@ low_level_output(struct netif *netif, struct pbuf *p)
   {
     vSemaphoreCreateBinary( xTxSemaphore );
   }
-#endif
 
-#if ETH_PAD_SIZE
-  pbuf_header( p, -ETH_PAD_SIZE );    /* drop the padding word */
-#endif
-
-#ifdef FREERTOS_USED
   /* Access to the MACB is guarded using a semaphore. */
   if( xSemaphoreTake( xTxSemaphore, netifGUARD_BLOCK_NBTICKS ) )
   {
 #endif
-    for( q = p; q != NULL; q = q->next )
+#if ETHERNET_CONF_TX_QUEUE_LEN
+    /* Keep the transmission order: queued frames go first. */
+    ethernetif_output_flush( netif );
+
+    if( ( ulTxQueueCount == 0 ) && ( ulMACBTxBuffersFree() >= tx_buffers_needed( p ) ) )
     {
-      /* Send the data from the pbuf to the interface, one pbuf at a time. The
-      size of the data in each pbuf is kept in the ->len variable.
-      This function also signals to the MACB that the packet should be sent. */
-      lMACBSend(&AVR32_MACB, q->payload, q->len, ( q->next == NULL ) );
+      xErr = low_level_send( p );
     }
+    else if( ulTxQueueCount < ETHERNET_CONF_TX_QUEUE_LEN )
+    {
+      /* The frame stays referenced until ethernetif_output_flush() sends it. */
+      pbuf_ref( p );
+      pxTxQueue[ ulTxQueueHead ] = p;
+      if( ++ulTxQueueHead >= ETHERNET_CONF_TX_QUEUE_LEN )
+      {
+        ulTxQueueHead = 0;
+      }
+      ulTxQueueCount++;
+      ETHERNETIF_STATS_INC(tx_queued);
+#if LINK_STATS
+      if( ulTxQueueCount > ethernetif_stats.tx_queue_max )
+      {
+        ethernetif_stats.tx_queue_max = ulTxQueueCount;
+      }
+#endif
+    }
+    else
+    {
+      ETHERNETIF_STATS_INC(tx_queue_full);
+      LINK_STATS_INC(link.drop);
+      xErr = ERR_WOULDBLOCK;
+    }
+#else
+    xErr = low_level_send( p );
+#endif
 #ifdef FREERTOS_USED
     xSemaphoreGive( xTxSemaphore );
   }
 #endif
 
-#if ETH_PAD_SIZE
-  pbuf_header( p, ETH_PAD_SIZE );     /* reclaim the padding word */
+  return xErr;
+}
+
+void
+ethernetif_output_flush(struct netif *netif)
+{
+#if ETHERNET_CONF_TX_QUEUE_LEN
+  struct pbuf             *p;
+
+  while( ulTxQueueCount != 0 )
+  {
+    p = pxTxQueue[ ulTxQueueTail ];
+    if( ulMACBTxBuffersFree() < tx_buffers_needed( p ) )
+    {
+      /* Wait for the MACB to free more Tx buffers. */
+      break;
+    }
+    low_level_send( p );
+    pbuf_free( p );
+    if( ++ulTxQueueTail >= ETHERNET_CONF_TX_QUEUE_LEN )
+    {
+      ulTxQueueTail = 0;
+    }
+    ulTxQueueCount--;
+  }
+#endif
+#if ETHERNET_CONF_TX_ZERO_COPY
+  tx_frames_release();
+#endif
+#if LINK_STATS
+  ethernetif_stats.tx_underruns = ulMACBTxUnderruns();
+  ethernetif_stats.tx_retry_limits = ulMACBTxRetryLimits();
 #endif
 
-  LINK_STATS_INC(link.xmit);  // Traces
+  ( void )netif; // Unused param, avoid a compiler warning.
+}
 
-  return ERR_OK;
+void
+ethernetif_set_rx_filter(ethernetif_rx_filter_fn filter)
+{
+  rx_filter = filter;
+}
+
+u8_t
+ethernetif_default_rx_filter(struct netif *netif, const u8_t *frame, u16_t len)
+{
+  const u8_t              *iphdr = frame + ( SIZEOF_ETH_HDR - ETH_PAD_SIZE );
+  u16_t                   type, hlen, port;
+  ip_addr_t               dest;
+#if LWIP_UDP
+  struct udp_pcb          *pcb;
+#endif
+
+  if( len < SIZEOF_ETH_HDR - ETH_PAD_SIZE )
+  {
+    return 0;
+  }
+
+  /* The frame is read byte by byte: the IP header is not word aligned. */
+  type = ( frame[ 12 ] << 8 ) | frame[ 13 ];
+  if( type == ETHTYPE_ARP )
+  {
+    return 1;
+  }
+  if( type != ETHTYPE_IP )
+  {
+    return 0;
+  }
+  if( len < ( SIZEOF_ETH_HDR - ETH_PAD_SIZE ) + IP_HLEN )
+  {
+    /* Too short to tell, let lwIP decide. */
+    return 1;
+  }
+
+  /* UDP ports are only in the first fragment. */
+  hlen = ( iphdr[ 0 ] & 0x0f ) * 4;
+  port = 0;
+  if( ( iphdr[ 9 ] == IP_PROTO_UDP )
+     && ( ( ( ( iphdr[ 6 ] << 8 ) | iphdr[ 7 ] ) & IP_OFFMASK ) == 0 )
+     && ( len >= ( SIZEOF_ETH_HDR - ETH_PAD_SIZE ) + hlen + 4 ) )
+  {
+    port = ( iphdr[ hlen + 2 ] << 8 ) | iphdr[ hlen + 3 ];
+  }
+
+  /* Only our address, broadcasts and multicasts once we have an address.
+     Except, as in ip_input(), the DHCP client port (and LWIP_IP_ACCEPT_UDP_PORT):
+     an OFFER or ACK can be unicast to the address being offered, while the
+     netif still has another one (static fallback, lease moving). */
+  SMEMCPY( &dest, &iphdr[ 16 ], sizeof( dest ) );
+  if( !ip_addr_isany( &netif->ip_addr ) && !ip_addr_cmp( &dest, &netif->ip_addr )
+     && !ip_addr_isbroadcast( &dest, netif ) && !ip_addr_ismulticast( &dest )
+#if LWIP_DHCP
+     && ( port != DHCP_CLIENT_PORT )
+#endif
+#ifdef LWIP_IP_ACCEPT_UDP_PORT
+     && ( ( port == 0 ) || !LWIP_IP_ACCEPT_UDP_PORT( htons( port ) ) )
+#endif
+    )
+  {
+    return 0;
+  }
+
+#if LWIP_UDP
+  if( port != 0 )
+  {
+    for( pcb = udp_pcbs; pcb != NULL; pcb = pcb->next )
+    {
+      if( pcb->local_port == port )
+      {
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif
+
+  return 1;
 }
 
 /**
@@ -231,14 +797,20 @@ static struct pbuf *low_level_input(struct netif *netif)
   struct pbuf             *p = NULL;
   struct pbuf             *q;
   u16_t                   len;
+  macb_rx_span_t          xSpan;
+  bool                    xFound;
+  u32_t                   ulPeek[ ( ETHERNETIF_RX_PEEK_LEN + 3 ) / 4 ];
+  unsigned long           ulOffset;
+#if ETHERNET_CONF_RX_ZERO_COPY
+  struct rx_pbuf          *pxRx;
+  unsigned long           ulBuffer, ulSegment, ulRemaining;
+  void                    *pvBuffer;
+#endif
 #ifdef FREERTOS_USED
   static xSemaphoreHandle xRxSemaphore = NULL;
 #endif
 
 
-  /* Parameter not used. */
-  ( void ) netif;
-
 #ifdef FREERTOS_USED
   if( xRxSemaphore == NULL )
   {
@@ -249,39 +821,88 @@ static struct pbuf *low_level_input(struct netif *netif)
   if( xSemaphoreTake( xRxSemaphore, netifGUARD_BLOCK_NBTICKS ) )
   {
 #endif
-    /* Obtain the size of the packet. */
-    len = ulMACBInputLength();
+    /* Obtain the next packet and its size. Packets rejected by the
+    prefilter are dropped before any pbuf is allocated. */
+    while( ( xFound = xMACBNextRxFrame( &xSpan ) ) && ( rx_filter != NULL )
+          && !rx_filter( netif, ( u8_t * )ulPeek,
+                         ulMACBRxFrameCopy( &xSpan, 0, ulPeek, sizeof( ulPeek ) ) ) )
+    {
+      vMACBRxFrameRelease( &xSpan );
+      ETHERNETIF_STATS_INC(rx_filtered);
+    }
 
-    if( len )
+    if( xFound )
     {
+      len = xSpan.ulLength;
 #if ETH_PAD_SIZE
       len += ETH_PAD_SIZE;    /* allow room for Ethernet padding */
 #endif
 
-      /* We allocate a pbuf chain of pbufs from the pool. */
-      p = pbuf_alloc( PBUF_RAW, len, PBUF_POOL );
-
-      if( p != NULL )
+#if ETHERNET_CONF_RX_ZERO_COPY
+      if( ulRxPbufsFree >= xSpan.ulCount )
+      {
+        /* Wrap the MACB buffers holding the frame in a chain of custom pbufs.
+        They are given back to the MACB when lwIP frees the pbufs. */
+        for( ulBuffer = 0, ulRemaining = len; ulRemaining != 0; ulBuffer++, ulRemaining -= q->len )
+        {
+          pxRx = pxRxPbufsFree;
+          pxRxPbufsFree = pxRx->next;
+          ulRxPbufsFree--;
+          pxRx->ulIndex = ulMACBRxFrameBuffer( &xSpan, ulBuffer, &pvBuffer );
+          pxRx->pucBuffer = ( u8_t * )pvBuffer;
+          ulSegment = ( ulRemaining > MACB_RX_BUFFER_SIZE ) ? MACB_RX_BUFFER_SIZE : ulRemaining;
+          /* payload_mem_len is the segment length: lwIP 1.4.0 rejects a
+          payload_mem_len larger than the requested length. */
+          q = pbuf_alloced_custom( PBUF_RAW, ulSegment, PBUF_REF,
+                                   &pxRx->pc, pvBuffer, ulSegment );
+          if( p == NULL )
+          {
+            p = q;
+          }
+          else
+          {
+            pbuf_cat( p, q );
+          }
+        }
+        vMACBRxFrameLend( &xSpan );
+      }
+      else
+#endif
       {
+#if ETHERNET_CONF_RX_ZERO_COPY
+        /* The custom pbufs are held by lwIP: copy the frame. */
+        ETHERNETIF_STATS_INC(rx_pool_copies);
+#endif
+        /* We allocate a pbuf chain of pbufs from the pool. */
+        p = pbuf_alloc( PBUF_RAW, len, PBUF_POOL );
+
+        if( p != NULL )
+        {
 #if ETH_PAD_SIZE
-        pbuf_header( p, -ETH_PAD_SIZE );    /* drop the padding word */
+          pbuf_header( p, -ETH_PAD_SIZE );    /* drop the padding word */
 #endif
 
-        /* Let the driver know we are going to read a new packet. */
-        vMACBRead( NULL, 0, len );
+          /* We iterate over the pbuf chain until we have read the entire
+          packet into the pbuf. */
+          ulOffset = 0;
+          for( q = p; q != NULL; q = q->next )
+          {
+            /* Read enough bytes to fill this pbuf in the chain. The
+            available data in the pbuf is given by the q->len variable. */
+            ulOffset += ulMACBRxFrameCopy( &xSpan, ulOffset, q->payload, q->len );
+          }
 
-        /* We iterate over the pbuf chain until we have read the entire
-        packet into the pbuf. */
-        for( q = p; q != NULL; q = q->next )
-        {
-          /* Read enough bytes to fill this pbuf in the chain. The
-          available data in the pbuf is given by the q->len variable. */
-          vMACBRead( q->payload, q->len, len );
-        }
+          /* Let the driver know the packet has been read. */
+          vMACBRxFrameRelease( &xSpan );
 
 #if ETH_PAD_SIZE
-        pbuf_header( p, ETH_PAD_SIZE );     /* reclaim the padding word */
+          pbuf_header( p, ETH_PAD_SIZE );     /* reclaim the padding word */
 #endif
+        }
+      }
+
+      if( p != NULL )
+      {
         LINK_STATS_INC(link.recv);
       }
       else
@@ -298,6 +919,33 @@ static struct pbuf *low_level_input(struct netif *netif)
   return p;
 }
 
+/**
+ * Pass a received frame to lwIP. With ETHERNET_CONF_RX_ZERO_COPY, the frame
+ * is still referenced when netif->input() returns if lwIP holds on to it: its
+ * Rx buffers are then moved to copies, see rx_frame_unlend().
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param p the received frame
+ */
+static void
+low_level_deliver(struct netif *netif, struct pbuf *p)
+{
+#if ETHERNET_CONF_RX_ZERO_COPY
+  pbuf_ref( p );
+#endif
+  if( ERR_OK != netif->input( p, netif ) )
+  {
+    pbuf_free( p );
+  }
+#if ETHERNET_CONF_RX_ZERO_COPY
+  if( p->ref > 1 )
+  {
+    rx_frame_unlend( p );
+  }
+  pbuf_free( p );
+#endif
+}
+
 /**
  * This function should be called when a packet is ready to be read
  * from the interface. It uses the function low_level_input() that
@@ -336,13 +984,59 @@ void ethernetif_input(void * pvParameters)
       }
 #endif
 
-    if( ERR_OK != netif->input( p, netif ) )
+    low_level_deliver( netif, p );
+#ifdef FREERTOS_USED
+  }
+#endif
+}
+
+#ifndef FREERTOS_USED
+u32_t
+ethernetif_input_burst(struct netif *netif, u32_t budget)
+{
+  struct pbuf       *p;
+  u32_t             frames = 0;
+
+  while( frames < budget )
+  {
+    /* move received packet into a new pbuf */
+    p = low_level_input( netif );
+    if( p == NULL )
     {
-      pbuf_free(p);
-      p = NULL;
+      break;
     }
-#ifdef FREERTOS_USED
+    frames++;
+
+    low_level_deliver( netif, p );
+  }
+
+#if LINK_STATS
+  ethernetif_stats.rx_ring_resets = ulMACBRxRingResets();
+  ethernetif_stats.rx_frames_per_poll[ ( frames < ETHERNETIF_RX_HIST_BINS - 1 ) ?
+                                       frames : ETHERNETIF_RX_HIST_BINS - 1 ]++;
+#endif
+
+  return frames;
+}
+#endif
+
+void
+ethernetif_link_task(struct netif *netif, u32_t now)
+{
+#if ETHERNET_CONF_PHY_ASYNC
+  u8_t up = xMACBPhyTask( now );
+
+  if( up && !netif_is_link_up( netif ) )
+  {
+    netif_set_link_up( netif );
+  }
+  else if( !up && netif_is_link_up( netif ) )
+  {
+    netif_set_link_down( netif );
   }
+#else
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(now);
 #endif
 }
 
@@ -387,6 +1081,9 @@ ethernetif_init(struct netif *netif)
    * is available...) */
   netif->output = etharp_output;
   netif->linkoutput = low_level_output;
+#if LWIP_IGMP
+  netif->igmp_mac_filter = low_level_igmp_mac_filter;
+#endif
 
   /* initialize the hardware */
   low_level_init(netif);
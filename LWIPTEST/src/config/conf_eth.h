@@ -65,6 +65,78 @@ to use an MII interface. */
 /*! Size of each Transmit buffer. */
 #define ETHERNET_CONF_TX_BUFFER_SIZE       512
 
+/*! set to 1 to hand the Rx buffers to lwIP as custom pbufs instead of copying
+    received frames into PBUF_POOL pbufs. The buffers return to the MACB when
+    lwIP frees the pbufs. The MACB stops at the first buffer it doesn't own,
+    so the buffers of a frame lwIP holds on to (TCP out-of-sequence segment,
+    IP fragment, refused data) are copied to the lwIP heap when netif->input()
+    returns. Stand-alone implementation only. */
+#define ETHERNET_CONF_RX_ZERO_COPY         0
+
+/*! set to 1 to point the Tx descriptors directly at the pbuf payloads instead
+    of copying frames into the Tx buffers. A frame stays referenced until the
+    MACB has sent it; ETHERNET_CONF_TX_BUFFER_SIZE is then unused. */
+#define ETHERNET_CONF_TX_ZERO_COPY         0
+
+/*! Number of frames queued by the lwIP port while all the Tx buffers are
+    in use, instead of waiting for the MACB. The queue is drained by
+    ethernetif_output_flush() from the main loop; frames sent while it is full
+    are refused with ERR_WOULDBLOCK. 0 keeps the waiting behaviour. */
+#define ETHERNET_CONF_TX_QUEUE_LEN         0
+
+/*! Maximum number of received frames handed to lwIP per EthernetTask() pass.
+    Draining bursts in one pass keeps the Rx ring from filling up (and being
+    reset) while the main loop is busy. */
+#define ETHERNET_CONF_RX_BUDGET            8
+
+/*! set to 1 to mask the Rx complete interrupt under heavy load and poll the
+    Rx ring every ms instead (stand-alone implementation only). Polling starts
+    above ETHERNET_CONF_RX_COALESCE_HIGH frames per ms and stops at
+    ETHERNET_CONF_RX_COALESCE_LOW frames per ms or less. */
+#define ETHERNET_CONF_RX_COALESCING        0
+#define ETHERNET_CONF_RX_COALESCE_HIGH     8
+#define ETHERNET_CONF_RX_COALESCE_LOW      2
+
+/*! set to 0 to have the MACB reject broadcast frames. Only for networks where
+    the peers know the board MAC address (static ARP entries): ARP requests
+    are broadcast. Multicast frames are always filtered in hardware, see
+    vMACBHashAdd(). */
+#define ETHERNET_CONF_RX_BROADCAST         1
+
+/*! set to 1 to drop, while still in the Rx buffers, the frames that are of
+    no use to the board (see ethernetif_default_rx_filter()), so they don't use
+    pbufs: IPv4 to another address, except to the DHCP client port, and UDP
+    to unbound ports. The latter are then not answered by an ICMP port
+    unreachable. */
+#define ETHERNET_CONF_RX_PREFILTER         0
+
+/*! set to 1 to bring the PHY up from the main loop (see xMACBPhyTask())
+    instead of waiting for it in xMACBInit(): the stack starts right away and
+    the link is reported to lwIP once auto-negotiation completes. */
+#define ETHERNET_CONF_PHY_ASYNC            1
+
+/*! link status check period when ETHERNET_CONF_PHY_ASYNC is set, in ms. */
+#define ETHERNET_CONF_PHY_POLL_MS          500
+
+/*! number of PHY register accesses that can be queued with xMACBMdioRead()
+    and xMACBMdioWrite(), 0 to disable. Needs ETHERNET_CONF_PHY_ASYNC. */
+#define ETHERNET_CONF_MDIO_QUEUE_LEN       4
+
+/*! period of the PHY status and error counters sampling, in ms, 0 to
+    disable (see vMACBGetPhyHealth()). Needs ETHERNET_CONF_MDIO_QUEUE_LEN. */
+#define ETHERNET_CONF_PHY_HEALTH_MS        1000
+
+/*! set to 1 to keep the last DHCP lease in the flash user page and ask the
+    server to confirm it at start-up (INIT-REBOOT), which takes one exchange
+    instead of the DISCOVER/OFFER/REQUEST/ACK sequence. */
+#define ETHERNET_CONF_DHCP_LEASE_CACHE     1
+
+/*! set to 1 to serve on the static address (ETHERNET_CONF_IPADDR0..3) right
+    from start-up while DHCP runs in the background, instead of only after
+    DHCP gives up. The connections open on the static address are closed when
+    a lease is obtained. */
+#define ETHERNET_CONF_DHCP_FALLBACK_EARLY  0
+
 /*! Clock definition */
 #define ETHERNET_CONF_SYSTEM_CLOCK         48000000
 
@@ -113,6 +113,13 @@
  */
 #define MEMP_NUM_TCP_PCB                6
 
+/**
+ * MEMP_USE_CUSTOM_POOLS==1: add the pools of lwippools.h (COMM_server
+ * sessions).
+ */
+#define MEMP_USE_CUSTOM_POOLS           1
+#include "COMM_session.h"
+
 /**
  * MEMP_NUM_TCP_PCB_LISTEN: the number of listening TCP connections.
  * (requires the LWIP_TCP option)
@@ -390,6 +397,13 @@
 #define LWIP_HAVE_LOOPIF                1
 #define LWIP_LOOPIF_MULTITHREADING      0
 
+/**
+ * LWIP_LOOPBACK_MAX_PBUFS: Maximum number of pbufs on queue for loopback
+ * sending for each netif (0 = disabled). Bounds what 127.0.0.1 traffic can
+ * take from the pools between two netif_poll_all() calls.
+ */
+#define LWIP_LOOPBACK_MAX_PBUFS         8
+
 /*
    ----------------------------------------------
    ---------- Sequential layer options ----------
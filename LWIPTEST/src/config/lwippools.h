@@ -0,0 +1,10 @@
+/*
+ * lwippools.h
+ *
+ * Application memp pools, included by lwIP with MEMP_USE_CUSTOM_POOLS.
+ * Included several times, and inside the memp type enum: only pools here,
+ * their types come from lwipopts.h.
+ */
+
+/* COMM_server sessions, with their receive and transmit rings */
+LWIP_MEMPOOL(COMM_SESSION, COMM_SERVER_MAX_SESSIONS, sizeof(struct COMM_server_struct), "COMM_SESSION")
@@ -27,41 +27,141 @@
  */
 #include <asf.h>
 #include "ethernet.h"
+#include "timer_wheel.h"
+#include "sys_clock.h"
+#include "scheduler.h"
 
-#define TIMER_FREQ	1000
-#define APPLI_CPU_SPEED	cpu_speed
+/* Set to 1 to put the CPU in idle mode between two passes of the main loop
+   until an interrupt (MACB, PHY or sleep timeout) brings new work. */
+#define APPLI_IDLE_SLEEP	1
+/* Longest sleep in ms; the tasks due sooner wake the CPU on time. */
+#define APPLI_IDLE_WAKEUP_MS	1000
 
 uint32_t cpu_speed;	
 volatile uint32_t time_of_day;
-volatile uint32_t CPU_counts;
+
+#if APPLI_IDLE_SLEEP
+/* COUNT/COMPARE interrupt, ends the sleep when the timeout expires. */
+#if defined(__GNUC__)
+__attribute__((__interrupt__))
+#elif defined(__ICCAVR32__)
+__interrupt
+#endif
+static void compare_irq_handler(void)
+{
+	// Writing COMPARE clears the interrupt, 0 disables it until the next sleep.
+	Set_sys_compare(0);
+}
+
+/* Sleep until an interrupt occurs, or for next_task_ms at most, unless an
+   interrupt already posted work. */
+static void idle_sleep(uint32_t next_task_ms)
+{
+	Disable_global_interrupt();
+	if ((ulMACBPendingEvents() == 0) && (next_task_ms != 0))
+	{
+		uint32_t wakeup_ms = APPLI_IDLE_WAKEUP_MS;
+
+		if (next_task_ms < wakeup_ms)
+		{
+			// The next task is due before: wake up for it.
+			wakeup_ms = next_task_ms;
+		}
+		Set_sys_compare((Get_sys_count() + sys_clock_ms_to_ticks(wakeup_ms)) | 1);
+		// Idle mode (0) with GMCLEAR (0x80): the global interrupt mask is
+		// cleared by the sleep itself, so no interrupt is lost in between.
+		__asm__ __volatile__ ("sleep 0x80");
+	}
+	else
+	{
+		Enable_global_interrupt();
+	}
+}
+#endif
+
+/* Heartbeat LED */
+static void blink_timer_fn(void *arg)
+{
+	LED_Toggle(LED0);
+}
+
+/* Frames, PHY and link */
+static uint32_t net_task(uint32_t now)
+{
+	return EthernetTask(now);
+}
+
+/* lwIP and application timers */
+static uint32_t timers_task(uint32_t now)
+{
+	return timer_wheel_run(now);
+}
+
+#if ETHERNET_CONF_PHY_HEALTH_MS
+/* PHY error counters */
+static uint32_t diag_task(uint32_t now)
+{
+	vMACBPhyHealthTask(now);
+	return ETHERNET_CONF_PHY_HEALTH_MS;
+}
+#endif
+
+/* Main loop tasks, highest priority first, with their budgets in us. The
+   application protocol handlers go between the timers and the diagnostics. */
+enum { TASK_NET, TASK_TIMERS };
+static sched_task_t tasks[] =
+{
+	{ "net", net_task, 500 },
+	{ "timers", timers_task, 200 },
+#if ETHERNET_CONF_PHY_HEALTH_MS
+	{ "diag", diag_task, 100 },
+#endif
+};
+
+/* A timer armed by another task may be due before the next run of the wheel */
+static void timers_notify(void)
+{
+	sched_wake(&tasks[TASK_TIMERS]);
+}
 
 int main (void)
 {
+	static wheel_timer_t blink_timer;
+	uint32_t next_task_ms;
+
 	// Insert system clock initialization code here (sysclk_init()).
 	sysclk_init();
 
 	board_init();
 	
 	cpu_speed = sysclk_get_cpu_hz();
+	sys_clock_init(cpu_speed);
 
 	// Insert application code here, after the board has been initialized.
+	timer_wheel_init(time_of_day);
 	EthernetInit();
+	timer_wheel_add(&blink_timer, 500, 500, blink_timer_fn, NULL);
+	sched_init(tasks, sizeof(tasks) / sizeof(tasks[0]));
+	timer_wheel_set_notify(timers_notify);
 	
-	uint32_t last_blink_time = 0;
-	
+#if APPLI_IDLE_SLEEP
+	INTC_register_interrupt((__int_handler)&compare_irq_handler, AVR32_CORE_COMPARE_IRQ, AVR32_INTC_INT0);
+#endif
+
 	for (;;)
 	{
-		U32 delta_time = Get_sys_count() - CPU_counts;
-		delta_time = ((U64)delta_time*TIMER_FREQ)/APPLI_CPU_SPEED;
-		CPU_counts += ((U64)delta_time*APPLI_CPU_SPEED)/TIMER_FREQ;
-		time_of_day += delta_time;
-		
-		if ((time_of_day - last_blink_time) >= 500)
+		time_of_day = (uint32_t)sys_clock_ms();
+	
+		// The pass below serves everything the interrupts posted so far.
+		if (ulMACBTakeEvents() != 0)
 		{
-			last_blink_time = time_of_day;
-			LED_Toggle(LED0);
+			sched_wake(&tasks[TASK_NET]);
 		}
-	
-		EthernetTask(time_of_day);
+		next_task_ms = sched_run();
+#if APPLI_IDLE_SLEEP
+		idle_sleep(next_task_ms);
+#else
+		(void)next_task_ms;
+#endif
 	}
 }
@@ -5,36 +5,66 @@
  *  Author: Butch
  */ 
 
+#include <string.h>
+
 #include "lwip/debug.h"
 #include "lwip/stats.h"
+#include "lwip/memp.h"
 #include "lwip/tcp.h"
 
 #include "COMM_server.h"
+#include "COMM_session.h"
 
 #ifndef _debug_
 #define _debug_	0
 #endif
 
-#define RX_MAX_SIZE    		256
-#define TX_MAX_SIZE    		1024
 #define COMM_SERVER_PORT	10001
 
+#if (RX_MAX_SIZE & (RX_MAX_SIZE - 1)) || (TX_MAX_SIZE & (TX_MAX_SIZE - 1))
+#error RX_MAX_SIZE and TX_MAX_SIZE must be powers of 2
+#endif
+
+#if (COMM_SERVER_RX_LOW > COMM_SERVER_RX_HIGH) || (COMM_SERVER_RX_HIGH >= RX_MAX_SIZE)
+#error COMM_SERVER_RX_LOW <= COMM_SERVER_RX_HIGH < RX_MAX_SIZE
+#endif
+
+#if COMM_SERVER_MAX_SESSIONS >= MEMP_NUM_TCP_PCB
+#error COMM_SERVER_MAX_SESSIONS must leave TCP pcbs to the other servers
+#endif
+
+#if (COMM_SERVER_RX_MAX_PBUFS < 1) || (COMM_SERVER_MAX_SESSIONS * COMM_SERVER_RX_MAX_PBUFS >= PBUF_POOL_SIZE)
+#error COMM_SERVER_RX_MAX_PBUFS must leave pool pbufs for reception
+#endif
+
+/* Received data not read yet, including segments refused while the
+   session was full: the session outlives the client's FIN until the
+   application has read it all. */
+#if COMM_SERVER_RX_PBUF
+#define RX_PENDING(es)	(((es)->rx_p != NULL) || ((es)->pcb->refused_data != NULL))
+#else
+#define RX_PENDING(es)	(((es)->rx_p != NULL) || ((es)->rx_head != (es)->rx_tail) \
+						 || ((es)->pcb->refused_data != NULL))
+#endif
+
+/* Data not handed to TCP yet: the FIN waits for it */
+#define TX_PENDING(es)	(((es)->p != NULL) || ((es)->tx_head != (es)->tx_tail))
+
 #ifndef	CloseConnection
 #define	CloseConnection()
 #endif
 
 //////////////////////////////////////////////////////////
 
-static Bool bIsConnected = false;
+static struct tcp_pcb *COMM_server_pcb;
 
-static U8 TX_Buffer[TX_MAX_SIZE];
-static U16 TX_Beg = 0, TX_End = 0;
+/* Open sessions, oldest first. The single client API uses the oldest. */
+static struct COMM_server_struct *sessions = NULL;
 
-static U8 RX_Buffer[RX_MAX_SIZE];
-static U16 rx_nHead, rx_nTail;
+static COMM_session_fn session_opened = NULL;
+static COMM_session_fn session_closed = NULL;
 
-static struct tcp_pcb *COMM_server_pcb;
-static struct tcp_pcb *last_tpcb = NULL;
+static COMM_server_stats_t stats;
 
 /* ECHO protocol states */
 enum COMM_server_states
@@ -42,16 +72,8 @@ enum COMM_server_states
   ES_NONE = 0,
   ES_ACCEPTED,
   ES_RECEIVED,
-  ES_CLOSING
-};
-
-/* structure for maintaing connection infos to be passed as argument 
-   to LwIP callbacks*/
-struct COMM_server_struct
-{
-  u8_t state;             /* current connection state */
-  struct tcp_pcb *pcb;    /* pointer on the current tcp_pcb */
-  struct pbuf *p;         /* pointer on the received/to be transmitted pbuf */
+  ES_CLOSING,		/* closed by the client */
+  ES_SHUTDOWN		/* closed by the application */
 };
 
 
@@ -64,10 +86,12 @@ static void COMM_server_send(struct tcp_pcb *tpcb, struct COMM_server_struct *es
 static void COMM_server_connection_close(struct tcp_pcb *tpcb, struct COMM_server_struct *es);
 
 /*////////////////////////////////////////////////////////////////////////*/
-static void COMM_recv(const void *data, u16_t len);
 static void TX_Data(struct tcp_pcb *tpcb, struct COMM_server_struct *es);
 static void ProcessData(struct tcp_pcb *tpcb, struct COMM_server_struct *es);
-static void queue_rcv_buf(unsigned char ch);
+static err_t session_rx(struct tcp_pcb *tpcb, struct COMM_server_struct *es, struct pbuf *p);
+static void session_unlink(struct COMM_server_struct *es);
+static void session_free(struct COMM_server_struct *es);
+static int session_done(struct COMM_server_struct *es);
 /*////////////////////////////////////////////////////////////////////////*/
 
 
@@ -129,13 +153,24 @@ static err_t COMM_server_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
   /* set priority for the newly accepted tcp connection newpcb */
   tcp_setprio(newpcb, TCP_PRIO_MIN);
 
-  /* allocate structure es to maintain tcp connection informations */
-  es = (struct COMM_server_struct *)mem_malloc(sizeof(struct COMM_server_struct));
+  /* allocate structure es to maintain tcp connection informations, none
+     left when COMM_SERVER_MAX_SESSIONS clients are connected */
+  es = (struct COMM_server_struct *)memp_malloc(MEMP_COMM_SESSION);
   if (es != NULL)
   {
+    struct COMM_server_struct **last;
+
+    es->next = NULL;
     es->state = ES_ACCEPTED;
     es->pcb = newpcb;
     es->p = NULL;
+    es->rx_p = NULL;
+    es->rx_off = 0;
+#if !COMM_SERVER_RX_PBUF
+    es->rx_head = es->rx_tail = 0;
+    es->rx_withheld = 0;
+#endif
+    es->tx_head = es->tx_tail = 0;
     
     /* pass newly allocated es structure as argument to newpcb */
     tcp_arg(newpcb, es);
@@ -143,32 +178,42 @@ static err_t COMM_server_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
     /* initialize lwip tcp_recv callback function for newpcb  */ 
     tcp_recv(newpcb, COMM_server_recv);
     
+    /* initialize lwip tcp_sent callback function for newpcb: what the
+       application writes before the client sends anything goes out as the
+       client acknowledges, not from the poll callback */
+    tcp_sent(newpcb, COMM_server_sent);
+    
     /* initialize lwip tcp_err callback function for newpcb  */
     tcp_err(newpcb, COMM_server_error);
     
     /* initialize lwip tcp_poll callback function for newpcb */
     tcp_poll(newpcb, COMM_server_poll, 1);
     
-    TX_Beg = 0;
-    TX_End = 0;
-	bIsConnected = true;
+    /* append to the sessions */
+    for (last = &sessions; *last != NULL; last = &(*last)->next)
+      ;
+    *last = es;
+    if (session_opened != NULL)
+    {
+      session_opened(es);
+    }
 
 #if _debug_
     debug_send("\r\n Connection Accepted.");
 #endif
 
 #if 0
-    TX_Buffer[0] = 0;
-    TX_Buffer[1] = 0;
-    TX_Buffer[2] = 0;
-    TX_Buffer[3] = 0;
+    es->tx_buf[0] = 0;
+    es->tx_buf[1] = 0;
+    es->tx_buf[2] = 0;
+    es->tx_buf[3] = 0;
 
     es->p = pbuf_alloc(PBUF_TRANSPORT, 4 , PBUF_POOL);
 
     if (es->p)
     {
       /* copy data to pbuf */
-      pbuf_take(es->p, (char*)TX_Buffer, 4);
+      pbuf_take(es->p, (char*)es->tx_buf, 4);
 
       /* send data */
       COMM_server_send(newpcb,es);
@@ -206,8 +251,11 @@ static err_t COMM_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, e
   if (p == NULL)
   {
     /* remote host closed connection */
-    es->state = ES_CLOSING;
-    if(es->p == NULL)
+    if (es->state != ES_SHUTDOWN)
+    {
+      es->state = ES_CLOSING;
+    }
+    if (session_done(es))
     {
        /* we're done sending, close connection */
        COMM_server_connection_close(tpcb, es);
@@ -215,9 +263,6 @@ static err_t COMM_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, e
     else
     {
       /* we're not done yet */
-      /* acknowledge received packet */
-      tcp_sent(tpcb, COMM_server_sent);
-      
       /* send remaining data*/
       COMM_server_send(tpcb, es);
     }
@@ -239,52 +284,22 @@ static err_t COMM_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, e
     /* first data chunk in p->payload */
     es->state = ES_RECEIVED;
     
-    /* initialize LwIP tcp_sent callback function */
-    tcp_sent(tpcb, COMM_server_sent);
-    
 #ifdef	_JEIL60_H_
-    while (p != NULL) {
-    	struct pbuf *ptr = p;
-
-    	COMM_recv(ptr->payload, ptr->len);
-    	ProcessData(tpcb, es);
-
-        p = ptr->next;
-        if (p!=NULL)
-        {
-        	pbuf_ref(p);
-        }
-
-        pbuf_free(ptr);
-        tcp_recved(tpcb, ptr->len);
-    }
+    ret_err = session_rx(tpcb, es, p);
 #else
     /* store reference to incoming pbuf (chain) */
     es->p = p;
     
     /* send back the received data (echo) */
     COMM_server_send(tpcb, es);
-#endif
     ret_err = ERR_OK;
+#endif
   }
-  else if (es->state == ES_RECEIVED)
+  else if ((es->state == ES_RECEIVED) || (es->state == ES_CLOSING))
   {
+    /* ES_CLOSING: data refused before the client's FIN, handed again */
 #if 1
-    while (p != NULL) {
-    	struct pbuf *ptr = p;
-
-    	COMM_recv(ptr->payload, ptr->len);
-    	ProcessData(tpcb, es);
-
-        p = ptr->next;
-        if (p!=NULL)
-        {
-        	pbuf_ref(p);
-        }
-
-        tcp_recved(tpcb, ptr->len);
-        pbuf_free(ptr);
-    }
+    ret_err = session_rx(tpcb, es, p);
 #else
     /* more data received from client and previous data has been already sent*/
     if(es->p == NULL)
@@ -302,8 +317,8 @@ static err_t COMM_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, e
       ptr = es->p;
       pbuf_chain(ptr,p);
     }
-#endif
     ret_err = ERR_OK;
+#endif
   }
   
   /* data received when connection already closed */
@@ -336,8 +351,12 @@ static void COMM_server_error(void *arg, err_t err)
   es = (struct COMM_server_struct *)arg;
   if (es != NULL)
   {
+    /* The pcb is already freed, e.g. aborted by lwIP when the DHCP address
+       changed: end the session as if it had been closed. */
+    session_unlink(es);
+
     /*  free es structure */
-    mem_free(es);
+    session_free(es);
   }
 }
 
@@ -363,15 +382,14 @@ static err_t COMM_server_poll(void *arg, struct tcp_pcb *tpcb)
     else
     {
       /* no remaining pbuf (chain)  */
-      if(es->state == ES_CLOSING)
+      if (session_done(es))
       {
         /*  close tcp connection */
         COMM_server_connection_close(tpcb, es);
       }
       else
       {
-   		if (TX_End>TX_Beg)
-   			TX_Data(tpcb, es);
+   		TX_Data(tpcb, es);
       }
     }
     ret_err = ERR_OK;
@@ -406,15 +424,12 @@ static err_t COMM_server_sent(void *arg, struct tcp_pcb *tpcb, u16_t len)
   }
   else
   {
-    /* if no more data to send and client closed connection*/
-    if(es->state == ES_CLOSING)
+    /* if no more data to send and either side closed the connection */
+    if (session_done(es))
       COMM_server_connection_close(tpcb, es);
     else
     {
-   	  if (TX_End>TX_Beg)
-   	  {
-   		TX_Data(tpcb, es);
-   	  }
+   	  TX_Data(tpcb, es);
     }
   }
   return ERR_OK;
@@ -445,6 +460,8 @@ static void COMM_server_send(struct tcp_pcb *tpcb, struct COMM_server_struct *es
 
     if (wr_err == ERR_OK)
     {
+      u16_t plen = ptr->len;
+
       /* continue with next pbuf in chain (if any) */
       es->p = ptr->next;
       
@@ -456,7 +473,10 @@ static void COMM_server_send(struct tcp_pcb *tpcb, struct COMM_server_struct *es
       
       /* free pbuf: will free pbufs up to es->p (because es->p has a reference count > 0) */
       pbuf_free(ptr);
-     
+
+      /* Update tcp window size to be advertized : should be called when received
+      data (with the amount plen) has been read by the application layer */
+      tcp_recved(tpcb, plen);
    }
    else if(wr_err == ERR_MEM)
    {
@@ -489,98 +509,380 @@ static void COMM_server_connection_close(struct tcp_pcb *tpcb, struct COMM_serve
 	/* delete es structure */
 	if (es != NULL)
 	{
-		mem_free(es);
+		session_unlink(es);
+		session_free(es);
 	}  
   
 	/* close tcp connection */
 	tcp_close(tpcb);
 
-	CloseConnection();
-
-	bIsConnected = false;
-
 	#if _debug_
 	debug_send("\r\n Session Closed.");
 	#endif
 }
 
-inline void queue_rcv_buf(unsigned char ch)
+/* Remove a session from the list, before it is freed */
+static void session_unlink(struct COMM_server_struct *es)
 {
-	RX_Buffer[rx_nHead] = ch;
-	rx_nHead = (rx_nHead+1)&(RX_MAX_SIZE-1);
-	if (rx_nHead==rx_nTail)
+	struct COMM_server_struct **link;
+
+	for (link = &sessions; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == es)
+		{
+			*link = es->next;
+			if (link == &sessions)
+			{
+				/* the session of the single client API */
+				CloseConnection();
+			}
+			break;
+		}
+	}
+	if (session_closed != NULL)
 	{
-		rx_nTail = (rx_nTail+1)&(RX_MAX_SIZE-1);
+		session_closed(es);
 	}
 }
 
-static void COMM_recv(const void *data, u16_t len)
+/* Free a session, counting the data it received that was never read */
+static void session_free(struct COMM_server_struct *es)
 {
-	char ch;
-	char *message = (char*)data;
-	while (len>0) {
-		ch = *message;
-		queue_rcv_buf(ch);
-		message++;
-		len--;
+	if (es->p != NULL)
+	{
+		pbuf_free(es->p);
 	}
+	if (es->rx_p != NULL)
+	{
+		stats.rx_dropped += es->rx_p->tot_len - es->rx_off;
+		pbuf_free(es->rx_p);
+	}
+#if !COMM_SERVER_RX_PBUF
+	stats.rx_dropped += (es->rx_head - es->rx_tail) & (RX_MAX_SIZE-1);
+#endif
+	memp_free(MEMP_COMM_SESSION, es);
 }
 
-static void TX_Data(struct tcp_pcb *tpcb, struct COMM_server_struct *es)
+/* Whether a closing session has nothing left to do: all its data is handed
+   to TCP and, when the client closed it, read by the application */
+static int session_done(struct COMM_server_struct *es)
 {
-    /* allocate pbuf */
-	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, TX_End, PBUF_POOL);
-    /* copy data to pbuf */
-    pbuf_take(p, (char*)TX_Buffer, TX_End);
-    TX_Beg = 0;
-    TX_End = 0;
+	if (TX_PENDING(es))
+		return 0;
+	if (es->state == ES_SHUTDOWN)
+		return 1;
+	return (es->state == ES_CLOSING) && !RX_PENDING(es);
+}
 
-    if (es->p==NULL)
-    {
-    	es->p = p;
-    	COMM_server_send(tpcb, es);
-    }
-    else
-    {
-    	struct pbuf *ptr = es->p;
-        pbuf_chain(ptr, p);
-    }
+/* Consume len bytes of the queued pbufs, freeing the ones done */
+static void session_rx_consume(struct COMM_server_struct *es, u16_t len)
+{
+	struct pbuf *ptr;
+
+	es->rx_off += len;
+	while ((es->rx_p != NULL) && (es->rx_off >= es->rx_p->len))
+	{
+		ptr = es->rx_p;
+		es->rx_off -= ptr->len;
+		es->rx_p = ptr->next;
+		if (es->rx_p != NULL)
+		{
+			pbuf_ref(es->rx_p);
+		}
+		pbuf_free(ptr);
+	}
 }
 
-void COMM_server_putdata(unsigned char ch)
+#if !COMM_SERVER_RX_PBUF
+/* Move the queued pbufs into the receive ring, as far as it has room. The
+   window is given back for the bytes moved unless the ring is above the high
+   watermark: they are then withheld until it drains to the low watermark,
+   which slows the client down. */
+static void session_rx_fill(struct COMM_server_struct *es)
+{
+	u16_t room, len, part, moved = 0;
+	const u8_t *src;
+
+	while (es->rx_p != NULL)
+	{
+		room = (es->rx_tail - es->rx_head - 1) & (RX_MAX_SIZE-1);
+		if (room == 0)
+			break;
+		len = es->rx_p->len - es->rx_off;
+		if (len > room)
+			len = room;
+		src = (const u8_t *)es->rx_p->payload + es->rx_off;
+
+		/* at most two contiguous parts of the ring */
+		part = RX_MAX_SIZE - es->rx_head;
+		if (part > len)
+			part = len;
+		memcpy(&es->rx_buf[es->rx_head], src, part);
+		memcpy(&es->rx_buf[0], src + part, len - part);
+		es->rx_head = (es->rx_head + len) & (RX_MAX_SIZE-1);
+
+		session_rx_consume(es, len);
+		moved += len;
+	}
+
+	if (moved == 0)
+		return;
+	if (((es->rx_head - es->rx_tail) & (RX_MAX_SIZE-1)) > COMM_SERVER_RX_HIGH)
+	{
+		es->rx_withheld += moved;
+		stats.rx_throttled += moved;
+	}
+	else
+	{
+		tcp_recved(es->pcb, moved);
+	}
+}
+#endif
+
+/* Queue the received pbufs. With COMM_SERVER_RX_PBUF the application reads
+   them in place and the window opens again as it does
+   (COMM_session_rx_commit()); otherwise they are copied into the ring.
+   Past COMM_SERVER_RX_MAX_PBUFS queued pbufs, p is refused with ERR_MEM:
+   lwIP keeps it and hands it again from tcp_fasttmr(). */
+static err_t session_rx(struct tcp_pcb *tpcb, struct COMM_server_struct *es, struct pbuf *p)
+{
+	if ((es->rx_p != NULL)
+		&& (pbuf_clen(es->rx_p) + pbuf_clen(p) > COMM_SERVER_RX_MAX_PBUFS))
+	{
+		stats.rx_refused++;
+		return ERR_MEM;
+	}
+
+	stats.rx_bytes += p->tot_len;
+	if (es->rx_p == NULL)
+		es->rx_p = p;
+	else
+		pbuf_cat(es->rx_p, p);
+#if !COMM_SERVER_RX_PBUF
+	session_rx_fill(es);
+#endif
+	ProcessData(tpcb, es);
+	return ERR_OK;
+}
+
+/* Move the transmit ring into the tcp send buffer, as much as it takes */
+static void TX_Data(struct tcp_pcb *tpcb, struct COMM_server_struct *es)
 {
-	if (TX_End<TX_MAX_SIZE)
+	u16_t len;
+
+	/* keep the order of the data already waiting in es->p */
+	if (es->p != NULL)
+		return;
+
+	while (es->tx_tail != es->tx_head)
 	{
-		TX_Buffer[TX_End] = ch;
-		TX_End++;
+		/* contiguous part of the ring */
+		if (es->tx_head > es->tx_tail)
+			len = es->tx_head - es->tx_tail;
+		else
+			len = TX_MAX_SIZE - es->tx_tail;
+		if (len > tcp_sndbuf(tpcb))
+			len = tcp_sndbuf(tpcb);
+
+		if ((len == 0) || (tcp_write(tpcb, &es->tx_buf[es->tx_tail], len, TCP_WRITE_FLAG_COPY) != ERR_OK))
+			break;
+		es->tx_tail = (es->tx_tail + len) & (TX_MAX_SIZE-1);
 	}
 }
 
 static void ProcessData(struct tcp_pcb *tpcb, struct COMM_server_struct *es)
 {
-	last_tpcb = tpcb;
+	TX_Data(tpcb, es);
+}
 
-	if (TX_End>TX_Beg)
-		TX_Data(tpcb, es);
+void COMM_server_set_callbacks(COMM_session_fn opened, COMM_session_fn closed)
+{
+	session_opened = opened;
+	session_closed = closed;
 }
 
-#ifdef	_JEIL60_H_
-int	COMM_server_getdata(unsigned char *ch)
+int COMM_session_putdata(COMM_session_t *es, unsigned char ch)
 {
-	EthernetTask(time_of_day);
-	
-	if	(rx_nHead!=rx_nTail)
+	u16_t next = (es->tx_head+1)&(TX_MAX_SIZE-1);
+
+	if ((next==es->tx_tail) || (es->state == ES_SHUTDOWN))
+	{
+		/* ring full, or closing */
+		return 0;
+	}
+	es->tx_buf[es->tx_head] = ch;
+	es->tx_head = next;
+	return 1;
+}
+
+int	COMM_session_getdata(COMM_session_t *es, unsigned char *ch)
+{
+	const unsigned char *data;
+
+	if	(COMM_session_rx_peek(es, &data) > 0)
 	{
-		*ch = RX_Buffer[rx_nTail++];
-		if (rx_nTail>=RX_MAX_SIZE) rx_nTail = 0;
+		*ch = *data;
+		COMM_session_rx_commit(es, 1);
 
 		return 1;
 	}
 	else return 0;
 }
+
+#if COMM_SERVER_RX_PBUF
+int COMM_session_rx_peek(COMM_session_t *es, const unsigned char **data)
+{
+	if (es->rx_p == NULL)
+		return 0;
+	*data = (const unsigned char *)es->rx_p->payload + es->rx_off;
+	return es->rx_p->len - es->rx_off;
+}
+
+void COMM_session_rx_commit(COMM_session_t *es, int len)
+{
+	if (len <= 0)
+		return;
+	tcp_recved(es->pcb, len);
+	session_rx_consume(es, len);
+}
+#else
+int COMM_session_rx_peek(COMM_session_t *es, const unsigned char **data)
+{
+	*data = &es->rx_buf[es->rx_tail];
+	if (es->rx_head >= es->rx_tail)
+		return es->rx_head - es->rx_tail;
+	return RX_MAX_SIZE - es->rx_tail;
+}
+
+void COMM_session_rx_commit(COMM_session_t *es, int len)
+{
+	es->rx_tail = (es->rx_tail + len) & (RX_MAX_SIZE-1);
+
+	/* room again for the data waiting in pbufs */
+	session_rx_fill(es);
+	if ((es->rx_withheld != 0)
+		&& (((es->rx_head - es->rx_tail) & (RX_MAX_SIZE-1)) <= COMM_SERVER_RX_LOW))
+	{
+		/* drained: open the window again */
+		tcp_recved(es->pcb, es->rx_withheld);
+		es->rx_withheld = 0;
+	}
+}
+#endif
+
+int COMM_session_read(COMM_session_t *es, void *buf, int maxlen)
+{
+	const unsigned char *data;
+	unsigned char *dst = (unsigned char *)buf;
+	int len, done = 0;
+
+	/* at most two contiguous parts */
+	while ((done < maxlen) && ((len = COMM_session_rx_peek(es, &data)) > 0))
+	{
+		if (len > maxlen - done)
+			len = maxlen - done;
+		memcpy(dst + done, data, len);
+		COMM_session_rx_commit(es, len);
+		done += len;
+	}
+	return done;
+}
+
+int COMM_session_tx_reserve(COMM_session_t *es, unsigned char **data)
+{
+	*data = &es->tx_buf[es->tx_head];
+	if (es->state == ES_SHUTDOWN)
+		return 0;
+	/* one byte always left free, to tell a full ring from an empty one */
+	if (es->tx_head < es->tx_tail)
+		return es->tx_tail - es->tx_head - 1;
+	return TX_MAX_SIZE - es->tx_head - (es->tx_tail == 0);
+}
+
+/* Hand the transmit ring to TCP now rather than on the next poll or ACK */
+static void session_tx_kick(struct COMM_server_struct *es)
+{
+	/* also in ES_CLOSING: the pcb is in CLOSE_WAIT and can still send */
+	TX_Data(es->pcb, es);
+	tcp_output(es->pcb);
+}
+
+void COMM_session_tx_commit(COMM_session_t *es, int len)
+{
+	es->tx_head = (es->tx_head + len) & (TX_MAX_SIZE-1);
+	session_tx_kick(es);
+}
+
+int COMM_session_write(COMM_session_t *es, const void *buf, int len)
+{
+	const unsigned char *src = (const unsigned char *)buf;
+	unsigned char *data;
+	int room, done = 0;
+
+	while ((done < len) && ((room = COMM_session_tx_reserve(es, &data)) > 0))
+	{
+		if (room > len - done)
+			room = len - done;
+		memcpy(data, src + done, room);
+		es->tx_head = (es->tx_head + room) & (TX_MAX_SIZE-1);
+		done += room;
+	}
+	if (done > 0)
+	{
+		session_tx_kick(es);
+	}
+	return done;
+}
+
+void COMM_session_close(COMM_session_t *es)
+{
+	es->state = ES_SHUTDOWN;
+	TX_Data(es->pcb, es);
+	if (session_done(es))
+	{
+		COMM_server_connection_close(es->pcb, es);
+	}
+	/* otherwise the rest of the transmit ring goes out from the sent and
+	   poll callbacks as the tcp send buffer empties, then the FIN */
+}
+
+void COMM_server_putdata(unsigned char ch)
+{
+	if (sessions != NULL)
+	{
+		COMM_session_putdata(sessions, ch);
+	}
+}
+
+void COMM_server_get_stats(COMM_server_stats_t *s)
+{
+	*s = stats;
+}
+
+int COMM_server_write(const void *buf, int len)
+{
+	if (sessions == NULL)
+		return 0;
+	return COMM_session_write(sessions, buf, len);
+}
+
+int COMM_server_read(void *buf, int maxlen)
+{
+	if (sessions == NULL)
+		return 0;
+	return COMM_session_read(sessions, buf, maxlen);
+}
+
+#ifdef	_JEIL60_H_
+int	COMM_server_getdata(unsigned char *ch)
+{
+	if (sessions == NULL)
+		return 0;
+	return COMM_session_getdata(sessions, ch);
+}
 #endif
 
 inline Bool COMM_IsConnected(void)
 {
-	return bIsConnected;
+	return sessions != NULL;
 }
@@ -8,12 +8,63 @@
 #ifndef _COMM_SERVER_H_
 #define _COMM_SERVER_H_
 
+/* A connected client. The handle is valid from the opened callback until
+   the closed callback. */
+typedef struct COMM_server_struct COMM_session_t;
+
+typedef void (*COMM_session_fn)(COMM_session_t *session);
+
+/* Receive counters, all sessions */
+typedef struct
+{
+	unsigned long rx_bytes;		/* received */
+	unsigned long rx_throttled;	/* window update held back above the high watermark */
+	unsigned long rx_dropped;	/* never read: the session ended first */
+	unsigned long rx_refused;	/* segments left to lwIP, too many pbufs queued */
+} COMM_server_stats_t;
+
 void COMM_server_start(void);
 
+/* Called when a client connects, and when its session ends (closed by
+   either side, or aborted). Either may be NULL. */
+void COMM_server_set_callbacks(COMM_session_fn opened, COMM_session_fn closed);
+
+/* Queue a byte to the client. Returns 0 if its transmit ring is full. */
+int COMM_session_putdata(COMM_session_t *session, unsigned char ch);
+
+/* Read a received byte. Returns 0 if there is none. */
+int	COMM_session_getdata(COMM_session_t *session, unsigned char *ch);
+
+/* Queue up to len bytes to the client, handed to TCP right away. Returns
+   the number of bytes queued, less than len when the transmit ring fills. */
+int COMM_session_write(COMM_session_t *session, const void *buf, int len);
+
+/* Read up to maxlen received bytes. Returns the number of bytes read. */
+int COMM_session_read(COMM_session_t *session, void *buf, int maxlen);
+
+/* Zero-copy access to the rings. peek/reserve return the length of the
+   contiguous part of the ring at *data: received bytes, or free room. The
+   ring wraps after it, so a second call may give more. commit then consumes
+   or queues len bytes of it. */
+int COMM_session_rx_peek(COMM_session_t *session, const unsigned char **data);
+void COMM_session_rx_commit(COMM_session_t *session, int len);
+int COMM_session_tx_reserve(COMM_session_t *session, unsigned char **data);
+void COMM_session_tx_commit(COMM_session_t *session, int len);
+
+/* Send what is queued, then close the connection. */
+void COMM_session_close(COMM_session_t *session);
+
+void COMM_server_get_stats(COMM_server_stats_t *stats);
+
+/* Single client API, on the oldest session */
 void COMM_server_putdata(unsigned char ch);
 
 int	COMM_server_getdata(unsigned char *ch);
 
+int COMM_server_write(const void *buf, int len);
+
+int COMM_server_read(void *buf, int maxlen);
+
 Bool COMM_IsConnected(void);
 
-#endif /* _COMM_SERVER_H_ */
\ No newline at end of file
+#endif /* _COMM_SERVER_H_ */
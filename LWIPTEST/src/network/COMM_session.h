@@ -0,0 +1,73 @@
+/*
+ * COMM_session.h
+ *
+ * COMM_server session state, allocated from the COMM_SESSION memp pool
+ * (see lwippools.h). Only COMM_server.c looks inside. Included by lwipopts.h:
+ * lwippools.h is read inside the memp type enum, where it cannot declare the
+ * structure itself.
+ */
+
+#ifndef _COMM_SESSION_H_
+#define _COMM_SESSION_H_
+
+#include <stdint.h>
+
+/* Number of clients connected at the same time. Each one also takes a
+   TCP pcb out of MEMP_NUM_TCP_PCB. */
+#ifndef COMM_SERVER_MAX_SESSIONS
+#define COMM_SERVER_MAX_SESSIONS	2
+#endif
+
+/* Set to 1 to keep the received pbufs queued in the session until the
+   application reads them, instead of copying them into the receive ring.
+   The TCP window then only opens as data is consumed. */
+#ifndef COMM_SERVER_RX_PBUF
+#define COMM_SERVER_RX_PBUF		0
+#endif
+
+/* Most pbufs queued in a session, whatever their size: a client sending
+   small segments would otherwise pin the pool pbufs of a whole TCP_WND.
+   Further segments are refused and kept by lwIP until the application
+   has read some. Also bounds what waits for room in the receive ring. */
+#ifndef COMM_SERVER_RX_MAX_PBUFS
+#define COMM_SERVER_RX_MAX_PBUFS	4
+#endif
+
+/* Receive and transmit ring sizes of each session, powers of 2 */
+#define RX_MAX_SIZE    		256
+#define TX_MAX_SIZE    		1024
+
+/* Receive ring watermarks, in bytes. Above COMM_SERVER_RX_HIGH the TCP
+   window is no longer given back for the data received, until the
+   application has read the ring down to COMM_SERVER_RX_LOW. */
+#ifndef COMM_SERVER_RX_HIGH
+#define COMM_SERVER_RX_HIGH		(RX_MAX_SIZE * 3 / 4)
+#endif
+#ifndef COMM_SERVER_RX_LOW
+#define COMM_SERVER_RX_LOW		(RX_MAX_SIZE / 4)
+#endif
+
+struct tcp_pcb;
+struct pbuf;
+
+/* structure for maintaing connection infos to be passed as argument 
+   to LwIP callbacks*/
+struct COMM_server_struct
+{
+  struct COMM_server_struct *next;	/* next session, in accept order */
+  uint8_t state;          /* current connection state */
+  struct tcp_pcb *pcb;    /* pointer on the current tcp_pcb */
+  struct pbuf *p;         /* pointer on the received/to be transmitted pbuf */
+
+  struct pbuf *rx_p;      /* received pbufs not consumed yet */
+  uint16_t rx_off;        /* bytes of rx_p already consumed */
+#if !COMM_SERVER_RX_PBUF
+  uint16_t rx_head, rx_tail;
+  uint16_t rx_withheld;   /* bytes read from rx_p not given back to the window */
+  uint8_t rx_buf[RX_MAX_SIZE];
+#endif
+  uint16_t tx_head, tx_tail;
+  uint8_t tx_buf[TX_MAX_SIZE];
+};
+
+#endif /* _COMM_SESSION_H_ */
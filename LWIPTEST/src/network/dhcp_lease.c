@@ -0,0 +1,75 @@
+/*
+ * dhcp_lease.c
+ *
+ * Last DHCP lease, kept in the flash user page across power cycles so the
+ * address can be confirmed with an INIT-REBOOT instead of a full DISCOVER.
+ *
+ * flashc_memcpy() rewrites the whole user page, keeping the other data it
+ * holds (the bootloader configuration words at its end).
+ */
+
+#include <stdint.h>
+
+#include "flashc.h"
+
+#include "dhcp_lease.h"
+
+#define DHCP_LEASE_MAGIC	0x4C454153	/* "LEAS" */
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t ipaddr;
+	uint32_t netmask;
+	uint32_t gw;
+	uint32_t check;
+} dhcp_lease_t;
+
+#if defined(__GNUC__)
+__attribute__((__section__(".userpage")))
+#endif
+static dhcp_lease_t dhcp_lease_nvram
+#if defined(__ICCAVR32__)
+@ "USERDATA32_C"
+#endif
+;
+
+static uint32_t dhcp_lease_check(const dhcp_lease_t *lease)
+{
+	return ~(lease->magic ^ lease->ipaddr ^ lease->netmask ^ lease->gw);
+}
+
+bool dhcp_lease_load(ip_addr_t *ipaddr, ip_addr_t *netmask, ip_addr_t *gw)
+{
+	dhcp_lease_t lease = dhcp_lease_nvram;
+
+	/* An erased page reads as all ones. */
+	if ((lease.magic != DHCP_LEASE_MAGIC) || (lease.check != dhcp_lease_check(&lease))
+		|| (lease.ipaddr == 0))
+	{
+		return false;
+	}
+	ip4_addr_set_u32(ipaddr, lease.ipaddr);
+	ip4_addr_set_u32(netmask, lease.netmask);
+	ip4_addr_set_u32(gw, lease.gw);
+	return true;
+}
+
+void dhcp_lease_save(const struct netif *netif)
+{
+	dhcp_lease_t lease;
+
+	lease.magic = DHCP_LEASE_MAGIC;
+	lease.ipaddr = ip4_addr_get_u32(&netif->ip_addr);
+	lease.netmask = ip4_addr_get_u32(&netif->netmask);
+	lease.gw = ip4_addr_get_u32(&netif->gw);
+	lease.check = dhcp_lease_check(&lease);
+
+	if ((dhcp_lease_nvram.magic == lease.magic) && (dhcp_lease_nvram.ipaddr == lease.ipaddr)
+		&& (dhcp_lease_nvram.netmask == lease.netmask) && (dhcp_lease_nvram.gw == lease.gw)
+		&& (dhcp_lease_nvram.check == lease.check))
+	{
+		return;
+	}
+	flashc_memcpy(&dhcp_lease_nvram, &lease, sizeof(lease), true);
+}
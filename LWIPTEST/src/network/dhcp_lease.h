@@ -0,0 +1,22 @@
+/*
+ * dhcp_lease.h
+ *
+ * Last DHCP lease, kept in the flash user page across power cycles so the
+ * address can be confirmed with an INIT-REBOOT instead of a full DISCOVER.
+ */
+
+#ifndef _DHCP_LEASE_H_
+#define _DHCP_LEASE_H_
+
+#include <stdbool.h>
+
+#include "lwip/netif.h"
+
+/* Read the cached lease. Returns false if none was saved. */
+bool dhcp_lease_load(ip_addr_t *ipaddr, ip_addr_t *netmask, ip_addr_t *gw);
+
+/* Save the address of the netif, only if it differs from the cached one so
+   the flash is not worn out by renewals. */
+void dhcp_lease_save(const struct netif *netif);
+
+#endif /* _DHCP_LEASE_H_ */
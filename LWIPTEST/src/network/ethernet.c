@@ -63,6 +63,7 @@
 #include "netif/etharp.h"
 #include "lwip/tcp.h"
 #include "lwip/tcp_impl.h"
+#include "lwip/ip_frag.h"
 
 #ifdef	FREERTOS_USED
 #if (HTTP_USED == 1)
@@ -81,6 +82,8 @@
 	#include "httpserver/httpd.h"
 #endif
 	#include "COMM_server.h"
+	#include "timer_wheel.h"
+	#include "dhcp_lease.h"
 #endif
 
 /* lwIP includes */
@@ -106,6 +109,15 @@
 #ifndef	portCHAR
 #define portCHAR        char
 #endif
+#ifndef ETHERNET_CONF_RX_BUDGET
+#define ETHERNET_CONF_RX_BUDGET  1
+#endif
+#ifndef ETHERNET_CONF_DHCP_LEASE_CACHE
+#define ETHERNET_CONF_DHCP_LEASE_CACHE  0
+#endif
+#ifndef ETHERNET_CONF_DHCP_FALLBACK_EARLY
+#define ETHERNET_CONF_DHCP_FALLBACK_EARLY  0
+#endif
 
 //_____ D E F I N I T I O N S ______________________________________________
 
@@ -121,6 +133,13 @@ static void prvlwIPInit( void );
 static void prvEthernetConfigureInterface(void * param);
 void dns_found(const char *name, struct ip_addr *addr, void *arg);
 void status_callback(struct netif *netif);
+#ifndef FREERTOS_USED
+/* Registration of the lwIP periodic timers on the timer wheel */
+static void prvStartTimers( void );
+#if LWIP_DHCP
+void DHCP_Process_Handle( void );
+#endif
+#endif
 
 
 #ifdef FREERTOS_USED
@@ -185,6 +204,14 @@ void EthernetInit( void )
 	// Kill this task.
 	vTaskDelete(NULL);
 #else
+	/* lwIP periodic timers */
+	prvStartTimers();
+
+#if LWIP_DHCP
+	/* Start DHCP now rather than on the first DHCP timer tick */
+	DHCP_Process_Handle();
+#endif
+
 	/* Http webserver Init */
 	httpd_init();
 
@@ -301,7 +328,7 @@ static void prvEthernetConfigureInterface(void * param)
 	/*  When the netif is fully configured this function must be called.*/
 	netif_set_up( &MACB_if );
 	
-#if LWIP_DHCP
+#if LWIP_DHCP && defined(FREERTOS_USED)
 	/* bring DHCP up */
 	dhcp_start( &MACB_if );
 	sendMessage("LwIP: DHCP Started");
@@ -309,8 +336,20 @@ static void prvEthernetConfigureInterface(void * param)
 }
 
 #ifndef FREERTOS_USED
-uint32_t last_arp_time = 0;
-uint32_t last_time = 0;
+/* Longest time between two calls to EthernetTask(), for the services it polls
+   (PHY bring-up, MDIO queue). */
+#ifndef ETHERNET_TASK_POLL_MS
+#define ETHERNET_TASK_POLL_MS	10
+#endif
+
+/* lwIP periodic timers, fired by timer_wheel_run() */
+static wheel_timer_t etharp_timer, tcp_timer;
+#if IP_REASSEMBLY
+static wheel_timer_t ip_reass_timer;
+#endif
+#if ETHERNET_CONF_RX_COALESCING
+uint32_t last_coalesce_time = 0;
+#endif
 
 #if LWIP_DHCP
 typedef enum
@@ -322,47 +361,97 @@ typedef enum
 } DHCP_State_TypeDef;
 
 DHCP_State_TypeDef DHCP_state = DHCP_START;
-uint32_t DHCPfineTimer = 0;
-uint32_t DHCPcoarseTimer = 0;
-void DHCP_Process_Handle( void );
+static wheel_timer_t dhcp_fine_timer, dhcp_coarse_timer;
 #endif
 
-void EthernetTask( uint32_t LocalTime )
+static void etharp_timer_fn( void *arg )
 {
-	ethernetif_input(&MACB_if);
+	etharp_tmr();
+}
 
-	if ((LocalTime - last_arp_time) >= ARP_TMR_INTERVAL)
-	{
-		etharp_tmr();
-		last_arp_time = LocalTime;
-	}
-	
-	if ((LocalTime - last_time) >= TCP_TMR_INTERVAL) 
-	{
-		tcp_tmr();
-		last_time = LocalTime;
-	}
+static void tcp_timer_fn( void *arg )
+{
+	tcp_tmr();
+}
+
+#if IP_REASSEMBLY
+static void ip_reass_timer_fn( void *arg )
+{
+	/* Drop the fragments of datagrams never completed */
+	ip_reass_tmr();
+}
+#endif
 
 #if LWIP_DHCP
+static void dhcp_fine_timer_fn( void *arg )
+{
 	/* Fine DHCP periodic process every 500ms */
-	if (LocalTime - DHCPfineTimer >= DHCP_FINE_TIMER_MSECS)
+	dhcp_fine_tmr();
+	if (DHCP_state != DHCP_TIMEOUT)
 	{
-		DHCPfineTimer = LocalTime;
-		dhcp_fine_tmr();
-		if ((DHCP_state != DHCP_ADDRESS_ASSIGNED)&&(DHCP_state != DHCP_TIMEOUT))
-		{
-			/* process DHCP state machine */
-			DHCP_Process_Handle();
-		}
+		/* process DHCP state machine, also while bound to follow the lease */
+		DHCP_Process_Handle();
 	}
+}
 
+static void dhcp_coarse_timer_fn( void *arg )
+{
 	/* DHCP Coarse periodic process every 60s */
-	if (LocalTime - DHCPcoarseTimer >= DHCP_COARSE_TIMER_MSECS)
+	dhcp_coarse_tmr();
+}
+#endif
+
+/*!
+ *  \brief register the lwIP periodic timers on the timer wheel.
+ */
+static void prvStartTimers( void )
+{
+	timer_wheel_add(&etharp_timer, ARP_TMR_INTERVAL, ARP_TMR_INTERVAL, etharp_timer_fn, NULL);
+	timer_wheel_add(&tcp_timer, TCP_TMR_INTERVAL, TCP_TMR_INTERVAL, tcp_timer_fn, NULL);
+#if IP_REASSEMBLY
+	timer_wheel_add(&ip_reass_timer, IP_TMR_INTERVAL, IP_TMR_INTERVAL, ip_reass_timer_fn, NULL);
+#endif
+#if LWIP_DHCP
+	timer_wheel_add(&dhcp_fine_timer, DHCP_FINE_TIMER_MSECS, DHCP_FINE_TIMER_MSECS, dhcp_fine_timer_fn, NULL);
+	timer_wheel_add(&dhcp_coarse_timer, DHCP_COARSE_TIMER_MSECS, DHCP_COARSE_TIMER_MSECS, dhcp_coarse_timer_fn, NULL);
+#endif
+}
+
+uint32_t EthernetTask( uint32_t LocalTime )
+{
+	uint32_t next = ETHERNET_TASK_POLL_MS;
+
+	/* Bring the PHY up and follow the link state */
+	ethernetif_link_task(&MACB_if, LocalTime);
+#if ETHERNET_CONF_MDIO_QUEUE_LEN
+	vMACBMdioTask();
+#endif
+
+#if ETHERNET_CONF_RX_COALESCING
+	/* Switch between Rx interrupts and Rx polling according to the load */
+	vMACBRxCoalesceTick(LocalTime - last_coalesce_time);
+	last_coalesce_time = LocalTime;
+	if (xMACBRxPolling())
 	{
-		DHCPcoarseTimer = LocalTime;
-		dhcp_coarse_tmr();
+		/* The Rx ring is polled every ms while its interrupt is masked. */
+		next = 1;
 	}
 #endif
+
+	if (ethernetif_input_burst(&MACB_if, ETHERNET_CONF_RX_BUDGET) == ETHERNET_CONF_RX_BUDGET)
+	{
+		/* Frames may be left in the Rx ring: come back without sleeping. */
+		next = 0;
+	}
+	ethernetif_output_flush(&MACB_if);
+
+#if LWIP_HAVE_LOOPIF || LWIP_NETIF_LOOPBACK
+	/* Deliver the packets sent to the loopback interface: without threads,
+	   lwIP only queues them. */
+	netif_poll_all();
+#endif
+
+	return next;
 }
 
 #if LWIP_DHCP
@@ -370,54 +459,145 @@ void EthernetTask( uint32_t LocalTime )
 
 uint32_t IPaddress = 0;
 
+/*!
+ *  \brief configure the static address, used when DHCP gives no lease.
+ */
+static void prvSetFallbackAddress( void )
+{
+	struct ip_addr ipaddr;
+	struct ip_addr netmask;
+	struct ip_addr gw;
+
+	IP4_ADDR(&ipaddr, ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1,
+		ETHERNET_CONF_IPADDR2, ETHERNET_CONF_IPADDR3);
+	IP4_ADDR(&netmask, ETHERNET_CONF_NET_MASK0, ETHERNET_CONF_NET_MASK1,
+		ETHERNET_CONF_NET_MASK2, ETHERNET_CONF_NET_MASK3);
+	IP4_ADDR(&gw, ETHERNET_CONF_GATEWAY_ADDR0, ETHERNET_CONF_GATEWAY_ADDR1,
+		ETHERNET_CONF_GATEWAY_ADDR2, ETHERNET_CONF_GATEWAY_ADDR3);
+	netif_set_addr(&MACB_if, &ipaddr , &netmask, &gw);
+}
+
+/*!
+ *  \brief report a new address through the netif status callback, which
+ *         lwIP only calls when the netif goes up or down, and keep a leased
+ *         one as the cached lease. The TCP connections on the previous address have been
+ *         aborted by lwIP.
+ */
+static void prvDhcpAddressChanged( void )
+{
+	if (MACB_if.ip_addr.addr == IPaddress)
+	{
+		return;
+	}
+	IPaddress = MACB_if.ip_addr.addr;
+#if ETHERNET_CONF_DHCP_LEASE_CACHE
+	if (MACB_if.dhcp->state == DHCP_BOUND)
+	{
+		dhcp_lease_save(&MACB_if);
+	}
+#endif
+	if (MACB_if.status_callback != NULL)
+	{
+		MACB_if.status_callback(&MACB_if);
+	}
+}
+
 void DHCP_Process_Handle( void )
 {
+#if ETHERNET_CONF_DHCP_LEASE_CACHE
 	struct ip_addr ipaddr;
 	struct ip_addr netmask;
 	struct ip_addr gw;
+#endif
 
 	switch (DHCP_state)
 	{
 	case DHCP_START:
 		{
-			dhcp_start(&MACB_if);
 			IPaddress = 0;
+#if ETHERNET_CONF_DHCP_LEASE_CACHE
+			if (dhcp_lease_load(&ipaddr, &netmask, &gw))
+			{
+				/* INIT-REBOOT: a single REQUEST for the cached address. An
+				   unknown address is NAKed, or the request times out, and
+				   lwIP goes back to DISCOVER. */
+				dhcp_start_reboot(&MACB_if, &ipaddr);
+			}
+			else
+#endif
+			{
+				dhcp_start(&MACB_if);
+			}
+#if ETHERNET_CONF_DHCP_FALLBACK_EARLY
+			prvSetFallbackAddress();
+			netif_set_up(&MACB_if);
+#endif
 			DHCP_state = DHCP_WAIT_ADDRESS;
 		}
 		break;
 
 	case DHCP_WAIT_ADDRESS:
 		{
-			/* Read the new IP address */
-			IPaddress = MACB_if.ip_addr.addr;
-
-			if (IPaddress!=0)
+			if (MACB_if.dhcp->state == DHCP_BOUND)
 			{
+				/* Read the new IP address. DHCP keeps running: lwIP renews
+				   the lease at T1 and rebinds at T2 (dhcp_coarse_tmr()). */
 				DHCP_state = DHCP_ADDRESS_ASSIGNED;
-
-				/* Stop DHCP */
-				dhcp_stop(&MACB_if);
+				prvDhcpAddressChanged();
 			}
-			else
+#if ETHERNET_CONF_DHCP_FALLBACK_EARLY
+			else if (!netif_is_up(&MACB_if))
 			{
-				/* DHCP timeout */
-				if (MACB_if.dhcp->tries > MAX_DHCP_TRIES)
+				/* Put down by lwIP when the link came up during the
+				   INIT-REBOOT, or by a NAK, which also clears the address:
+				   keep serving on the static address. */
+				if (ip_addr_isany(&MACB_if.ip_addr))
 				{
-					DHCP_state = DHCP_TIMEOUT;
+					prvSetFallbackAddress();
+				}
+				netif_set_up(&MACB_if);
+			}
+#else
+			else if (MACB_if.dhcp->tries > MAX_DHCP_TRIES)
+			{
+				/* DHCP timeout */
+				DHCP_state = DHCP_TIMEOUT;
 
-					/* Stop DHCP */
-					dhcp_stop(&MACB_if);
+				/* Stop DHCP */
+				dhcp_stop(&MACB_if);
 
-					/* Static address used */
-					IP4_ADDR(&ipaddr, ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1,
-						ETHERNET_CONF_IPADDR2, ETHERNET_CONF_IPADDR3);
-					IP4_ADDR(&netmask, ETHERNET_CONF_NET_MASK0, ETHERNET_CONF_NET_MASK1,
-						ETHERNET_CONF_NET_MASK2, ETHERNET_CONF_NET_MASK3);
-					IP4_ADDR(&gw, ETHERNET_CONF_GATEWAY_ADDR0, ETHERNET_CONF_GATEWAY_ADDR1,
-						ETHERNET_CONF_GATEWAY_ADDR2, ETHERNET_CONF_GATEWAY_ADDR3);
-					netif_set_addr(&MACB_if, &ipaddr , &netmask, &gw);
+				/* Static address used */
+				prvSetFallbackAddress();
+				netif_set_up(&MACB_if);
+			}
+#endif
+		}
+		break;
 
-				}
+	case DHCP_ADDRESS_ASSIGNED:
+		{
+			switch (MACB_if.dhcp->state)
+			{
+			case DHCP_BOUND:
+				/* A renewal or a rebinding may have brought a new address */
+				prvDhcpAddressChanged();
+				break;
+			case DHCP_RENEWING:
+			case DHCP_REBINDING:
+			case DHCP_REBOOTING:
+				/* The address is still ours until the lease runs out, or
+				   until a NAK of the REQUEST sent on link-up */
+				break;
+			default:
+				/* Lease lost (NAK, or no answer until the end of the
+				   rebinding): lwIP went back to DISCOVER. */
+				DHCP_state = DHCP_WAIT_ADDRESS;
+#if ETHERNET_CONF_DHCP_FALLBACK_EARLY
+				prvSetFallbackAddress();
+				netif_set_up(&MACB_if);
+#endif
+				prvDhcpAddressChanged();
+				break;
 			}
 		}
 		break;
@@ -427,4 +607,3 @@ void DHCP_Process_Handle( void )
 }
 #endif
 #endif
-
@@ -63,7 +63,15 @@ portTASK_FUNCTION( vStartEthernetTask, pvParameters );
 #else
 void EthernetInit( void );
 
-void EthernetTask( uint32_t LocalTime );
+/*! \brief serve the network: PHY, received and queued frames. The lwIP
+ *         timers run from the timer wheel.
+ *
+ *  \param LocalTime   Input; current time in ms.
+ *
+ *  \return the time in ms until it must be called again, 0 if frames are
+ *          left in the Rx ring.
+ */
+uint32_t EthernetTask( uint32_t LocalTime );
 #endif
 
 #endif
@@ -0,0 +1,236 @@
+/*
+ * timer_wheel.c
+ *
+ * Timer wheel driving the lwIP periodic timers and the application timeouts
+ * from the main loop.
+ *
+ * Each slot covers TIMER_WHEEL_TICK_MS; a timer is linked into the slot of
+ * the tick its deadline falls in, modulo TIMER_WHEEL_SLOTS, so arming,
+ * cancelling and firing a timer are O(1). The slot of a tick is only looked
+ * at once the tick is over. A bitmap of the slots holding timers gives the
+ * next deadline without going through the timers.
+ */
+
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+#if (TIMER_WHEEL_SLOTS & (TIMER_WHEEL_SLOTS - 1)) != 0
+#error TIMER_WHEEL_SLOTS must be a power of 2
+#endif
+
+#if TIMER_WHEEL_SLOTS > 32
+#error TIMER_WHEEL_SLOTS must fit the 32 bit slot bitmap
+#endif
+
+/* Count of trailing zero bits, as in the ASF compiler.h */
+#ifndef ctz
+#define ctz(u)	__builtin_ctz(u)
+#endif
+
+static wheel_timer_t *slots[TIMER_WHEEL_SLOTS];
+
+/* Bit i set when slots[i] may hold timers. Set when a timer is inserted,
+   cleared when the slot is found empty by timer_wheel_next(). */
+static uint32_t slots_used;
+
+/* Start of the tick covered by slots[wheel_slot], in ms. */
+static uint32_t wheel_time;
+static uint32_t wheel_slot;
+
+/* Last time given to timer_wheel_run(), timers are armed relative to it. */
+static uint32_t wheel_now;
+
+/* Deadline last returned by timer_wheel_run(), in ms, when wheel_due_set */
+static uint32_t wheel_due;
+static int wheel_due_set;
+static int wheel_running;
+static timer_wheel_notify_fn wheel_notify;
+
+static void timer_link(wheel_timer_t **head, wheel_timer_t *timer)
+{
+	timer->next = *head;
+	if (*head != NULL)
+	{
+		(*head)->pprev = &timer->next;
+	}
+	*head = timer;
+	timer->pprev = head;
+}
+
+static void timer_unlink(wheel_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != NULL)
+	{
+		timer->next->pprev = timer->pprev;
+	}
+	timer->pprev = NULL;
+}
+
+/* Link a timer into the slot of the tick its deadline falls in, the current
+   one if the deadline is already past. */
+static void timer_insert(wheel_timer_t *timer)
+{
+	int32_t ahead = (int32_t)(timer->expires - wheel_time);
+	uint32_t ticks = (ahead > 0) ? (uint32_t)ahead / TIMER_WHEEL_TICK_MS : 0;
+	uint32_t slot = (wheel_slot + ticks) & (TIMER_WHEEL_SLOTS - 1);
+
+	timer_link(&slots[slot], timer);
+	slots_used |= 1UL << slot;
+}
+
+/* Move the timers of a slot whose deadline is before end to the list. */
+static void timer_collect(wheel_timer_t **slot, uint32_t end, wheel_timer_t **expired)
+{
+	wheel_timer_t *timer, *next;
+
+	for (timer = *slot; timer != NULL; timer = next)
+	{
+		next = timer->next;
+		if ((int32_t)(timer->expires - end) < 0)
+		{
+			timer_unlink(timer);
+			timer_link(expired, timer);
+		}
+	}
+}
+
+/* Time until the end of the tick of the first slot holding timers, from
+   the current one. Its timers may only be due on a later turn of the wheel:
+   the wheel is then run once for nothing, which costs less than looking at
+   every timer each time. */
+static uint32_t timer_wheel_next(uint32_t now)
+{
+	uint32_t used, ticks, slot;
+	int32_t ahead;
+
+	for (;;)
+	{
+		if (slots_used == 0)
+		{
+			return TIMER_WHEEL_NONE;
+		}
+
+		/* bitmap rotated so that bit 0 is the current slot */
+		used = slots_used >> wheel_slot;
+		if (wheel_slot != 0)
+		{
+			used |= slots_used << (TIMER_WHEEL_SLOTS - wheel_slot);
+		}
+		ticks = ctz(used);
+
+		slot = (wheel_slot + ticks) & (TIMER_WHEEL_SLOTS - 1);
+		if (slots[slot] != NULL)
+		{
+			break;
+		}
+		slots_used &= ~(1UL << slot);
+	}
+
+	ahead = (int32_t)(wheel_time + (ticks + 1) * TIMER_WHEEL_TICK_MS - now);
+	return (ahead > 0) ? (uint32_t)ahead : 0;
+}
+
+void timer_wheel_init(uint32_t now)
+{
+	uint32_t i;
+
+	for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+	{
+		slots[i] = NULL;
+	}
+	slots_used = 0;
+	wheel_time = now;
+	wheel_slot = 0;
+	wheel_now = now;
+	wheel_due_set = 0;
+	wheel_running = 0;
+}
+
+void timer_wheel_set_notify(timer_wheel_notify_fn fn)
+{
+	wheel_notify = fn;
+}
+
+void timer_wheel_add(wheel_timer_t *timer, uint32_t delay, uint32_t period,
+		timer_wheel_fn fn, void *arg)
+{
+	timer_wheel_cancel(timer);
+	timer->expires = wheel_now + delay;
+	timer->period = period;
+	timer->fn = fn;
+	timer->arg = arg;
+	timer_insert(timer);
+
+	/* The deadlines of the timers armed by the callbacks are in the value
+	   timer_wheel_run() returns. */
+	if ((wheel_notify != NULL) && !wheel_running
+		&& (!wheel_due_set || ((int32_t)(timer->expires - wheel_due) < 0)))
+	{
+		wheel_notify();
+	}
+}
+
+void timer_wheel_cancel(wheel_timer_t *timer)
+{
+	if (timer->pprev != NULL)
+	{
+		timer_unlink(timer);
+	}
+}
+
+uint32_t timer_wheel_run(uint32_t now)
+{
+	wheel_timer_t *expired = NULL, *timer;
+	uint32_t ticks, i, next;
+
+	wheel_now = now;
+
+	ticks = (now - wheel_time) / TIMER_WHEEL_TICK_MS;
+	if (ticks >= TIMER_WHEEL_SLOTS)
+	{
+		/* Late by more than a turn of the wheel: look at every slot once. */
+		wheel_time += ticks * TIMER_WHEEL_TICK_MS;
+		wheel_slot = (wheel_slot + ticks) & (TIMER_WHEEL_SLOTS - 1);
+		for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+		{
+			timer_collect(&slots[i], wheel_time, &expired);
+		}
+	}
+	else
+	{
+		/* Go through the ticks over since the last call. */
+		while (ticks--)
+		{
+			wheel_time += TIMER_WHEEL_TICK_MS;
+			timer_collect(&slots[wheel_slot], wheel_time, &expired);
+			wheel_slot = (wheel_slot + 1) & (TIMER_WHEEL_SLOTS - 1);
+		}
+	}
+
+	/* Fire the expired timers. A callback may arm or cancel any timer,
+	   including the ones still in the expired list. */
+	wheel_running = 1;
+	while ((timer = expired) != NULL)
+	{
+		timer_unlink(timer);
+		if (timer->period != 0)
+		{
+			timer->expires += timer->period;
+			if ((int32_t)(timer->expires - now) <= 0)
+			{
+				/* Too late to catch up: skip the periods missed. */
+				timer->expires = now + timer->period;
+			}
+			timer_insert(timer);
+		}
+		timer->fn(timer->arg);
+	}
+	wheel_running = 0;
+
+	next = timer_wheel_next(now);
+	wheel_due_set = (next != TIMER_WHEEL_NONE);
+	wheel_due = now + next;
+	return next;
+}
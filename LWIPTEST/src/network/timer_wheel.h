@@ -0,0 +1,62 @@
+/*
+ * timer_wheel.h
+ *
+ * Timer wheel driving the lwIP periodic timers and the application timeouts
+ * from the main loop.
+ */
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+/* Resolution of the wheel: a timer fires at most TIMER_WHEEL_TICK_MS late. */
+#ifndef TIMER_WHEEL_TICK_MS
+#define TIMER_WHEEL_TICK_MS		10
+#endif
+
+/* Number of slots, a power of 2. Timers further than
+   TIMER_WHEEL_SLOTS * TIMER_WHEEL_TICK_MS away stay in their slot for more
+   than one turn of the wheel. */
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS		32
+#endif
+
+/* Returned by timer_wheel_run() when no timer is pending. */
+#define TIMER_WHEEL_NONE		UINT32_MAX
+
+typedef void (*timer_wheel_fn)(void *arg);
+typedef void (*timer_wheel_notify_fn)(void);
+
+/* A timer, owned by the caller and linked into the wheel while pending. */
+typedef struct wheel_timer
+{
+	struct wheel_timer *next;
+	struct wheel_timer **pprev;	/* NULL while not pending */
+	uint32_t expires;		/* deadline, in ms */
+	uint32_t period;		/* 0 for a one-shot timer */
+	timer_wheel_fn fn;
+	void *arg;
+} wheel_timer_t;
+
+/* Start the wheel at the given time, in ms. */
+void timer_wheel_init(uint32_t now);
+
+/* Have fn called when a timer armed outside timer_wheel_run() is due before
+   the deadline it last returned, so that the wheel is run again sooner.
+   NULL to disable. */
+void timer_wheel_set_notify(timer_wheel_notify_fn fn);
+
+/* Arm a timer to call fn(arg) in delay ms, then every period ms if period is
+   not 0. An already pending timer is re-armed. O(1). */
+void timer_wheel_add(wheel_timer_t *timer, uint32_t delay, uint32_t period,
+		timer_wheel_fn fn, void *arg);
+
+/* Disarm a timer, pending or not. O(1). */
+void timer_wheel_cancel(wheel_timer_t *timer);
+
+/* Call the timers expired at the given time, in ms. Returns the time until
+   the next deadline, or TIMER_WHEEL_NONE. */
+uint32_t timer_wheel_run(uint32_t now);
+
+#endif /* _TIMER_WHEEL_H_ */
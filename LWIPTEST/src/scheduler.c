@@ -0,0 +1,103 @@
+/*
+ * scheduler.c
+ *
+ * Run-to-completion scheduler for the main loop: prioritised tasks, with
+ * execution time and lateness accounting.
+ *
+ * Tasks cannot be preempted, but the highest priority task ready runs between
+ * any two others, so a long application task delays the network task by one
+ * run at most. Run times are measured with the COUNT cycle counter.
+ */
+
+#include <asf.h>
+
+#include "sys_clock.h"
+#include "scheduler.h"
+
+static sched_task_t *sched_tasks;
+static uint32_t sched_count;
+
+static bool sched_ready(const sched_task_t *task, uint32_t now)
+{
+	return task->woken || (task->timed && ((int32_t)(now - task->due) >= 0));
+}
+
+void sched_init(sched_task_t *tasks, uint32_t count)
+{
+	uint32_t i;
+
+	sched_tasks = tasks;
+	sched_count = (count > 32) ? 32 : count;
+	for (i = 0; i < sched_count; i++)
+	{
+		/* Budgets in COUNT cycles, to be compared with the measured runs. */
+		tasks[i].budget_cycles = sys_clock_ms_to_ticks(tasks[i].budget_us) / 1000;
+		tasks[i].woken = true;
+	}
+}
+
+void sched_wake(sched_task_t *task)
+{
+	task->woken = true;
+}
+
+uint32_t sched_run(void)
+{
+	sched_task_t *task;
+	uint32_t ran = 0, i, now, start, cycles, delay, next = SCHED_IDLE;
+
+	now = (uint32_t)sys_clock_ms();
+	i = 0;
+	while (i < sched_count)
+	{
+		task = &sched_tasks[i];
+		if ((ran & (1UL << i)) || !sched_ready(task, now))
+		{
+			i++;
+			continue;
+		}
+
+		if (task->timed && ((int32_t)(now - task->due) > (int32_t)task->max_late_ms))
+		{
+			task->max_late_ms = now - task->due;
+		}
+		task->woken = false;
+
+		start = Get_sys_count();
+		delay = task->fn(now);
+		cycles = Get_sys_count() - start;
+
+		task->runs++;
+		if (cycles > task->wcet_cycles)
+		{
+			task->wcet_cycles = cycles;
+		}
+		if (task->budget_cycles && (cycles > task->budget_cycles))
+		{
+			task->overruns++;
+		}
+
+		now = (uint32_t)sys_clock_ms();
+		task->timed = (delay != SCHED_IDLE);
+		task->due = now + delay;
+		ran |= 1UL << i;
+
+		/* Back to the highest priority task ready. */
+		i = 0;
+	}
+
+	/* Time until the next task is due. */
+	for (i = 0; i < sched_count; i++)
+	{
+		task = &sched_tasks[i];
+		if (sched_ready(task, now))
+		{
+			return 0;
+		}
+		if (task->timed && (task->due - now < next))
+		{
+			next = task->due - now;
+		}
+	}
+	return next;
+}
@@ -0,0 +1,54 @@
+/*
+ * scheduler.h
+ *
+ * Run-to-completion scheduler for the main loop: prioritised tasks, with
+ * execution time and lateness accounting.
+ */
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Returned by a task, or by sched_run(), when nothing is due before the
+   next sched_wake(). */
+#define SCHED_IDLE		UINT32_MAX
+
+/* A task runs to completion and returns the time in ms until it must run
+   again: 0 as soon as possible, SCHED_IDLE only on sched_wake(). */
+typedef uint32_t (*sched_fn)(uint32_t now);
+
+typedef struct
+{
+	/* set by the application */
+	const char *name;
+	sched_fn fn;
+	uint32_t budget_us;		/* expected worst case run time */
+
+	/* state */
+	volatile bool woken;
+	bool timed;
+	uint32_t due;			/* in ms, when timed */
+	uint32_t budget_cycles;
+
+	/* statistics */
+	uint32_t runs;
+	uint32_t wcet_cycles;		/* longest run, in COUNT cycles */
+	uint32_t overruns;		/* runs longer than budget_us */
+	uint32_t max_late_ms;		/* longest delay past due */
+} sched_task_t;
+
+/* Take an array of tasks, highest priority first. Each one runs once at
+   start. At most 32 tasks. */
+void sched_init(sched_task_t *tasks, uint32_t count);
+
+/* Make a task run on the next sched_run(). May be called from interrupts. */
+void sched_wake(sched_task_t *task);
+
+/* Run the tasks due or woken, each one at most once, always going back to
+   the highest priority task ready after each run. Returns the time in ms until
+   the next task is due, 0 if one is ready, or SCHED_IDLE. */
+uint32_t sched_run(void);
+
+#endif /* _SCHEDULER_H_ */
@@ -0,0 +1,91 @@
+/*
+ * sys_clock.c
+ *
+ * Monotonic clock built on the CPU COUNT register, also lwIP's sys_now().
+ *
+ * The elapsed COUNT ticks are converted with reciprocals computed once by
+ * sys_clock_init(): a 32x32->64 multiply per call instead of 64-bit
+ * divisions, which the AVR32 only has in software.
+ */
+
+#include <asf.h>
+
+#include "lwip/sys.h"
+
+#include "sys_clock.h"
+
+/* COUNT ticks per ms. */
+static uint32_t ticks_per_ms;
+
+/* floor(2^32 / ticks_per_ms): ms = (ticks * ms_recip) >> 32, may be 2 short. */
+static uint32_t ms_recip;
+
+/* floor(1000 * 2^32 / ticks_per_ms): us = (ticks * us_recip) >> 32, for ticks
+   below ticks_per_ms. */
+static uint32_t us_recip;
+
+/* Time in ms, and value of COUNT at that exact time. */
+static uint64_t clock_ms;
+static uint32_t clock_count;
+
+void sys_clock_init(uint32_t cpu_hz)
+{
+	ticks_per_ms = cpu_hz / 1000;
+	ms_recip = (uint32_t)((1ULL << 32) / ticks_per_ms);
+	us_recip = (uint32_t)((1000ULL << 32) / ticks_per_ms);
+	clock_ms = 0;
+	clock_count = Get_sys_count();
+}
+
+/* Bring clock_ms up to date and return it, with the ticks since that ms. */
+static uint64_t sys_clock_update(uint32_t *ticks)
+{
+	uint32_t delta, ms;
+	uint64_t now;
+	irqflags_t flags;
+
+	// Interrupt handlers may read the clock too.
+	flags = cpu_irq_save();
+
+	// Unsigned arithmetic absorbs the COUNT wrap.
+	delta = Get_sys_count() - clock_count;
+	ms = (uint32_t)(((uint64_t)delta * ms_recip) >> 32);
+	delta -= ms * ticks_per_ms;
+	while (delta >= ticks_per_ms)
+	{
+		ms++;
+		delta -= ticks_per_ms;
+	}
+	clock_ms += ms;
+	clock_count += ms * ticks_per_ms;
+	now = clock_ms;
+
+	cpu_irq_restore(flags);
+	*ticks = delta;
+	return now;
+}
+
+uint64_t sys_clock_ms(void)
+{
+	uint32_t ticks;
+
+	return sys_clock_update(&ticks);
+}
+
+uint64_t sys_clock_us(void)
+{
+	uint32_t ticks;
+	uint64_t ms = sys_clock_update(&ticks);
+
+	return ms * 1000 + (uint32_t)(((uint64_t)ticks * us_recip) >> 32);
+}
+
+uint32_t sys_clock_ms_to_ticks(uint32_t ms)
+{
+	return ms * ticks_per_ms;
+}
+
+u32_t sys_now(void)
+{
+	return (u32_t)sys_clock_ms();
+}
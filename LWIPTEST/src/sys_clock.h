@@ -0,0 +1,24 @@
+/*
+ * sys_clock.h
+ *
+ * Monotonic clock built on the CPU COUNT register, also lwIP's sys_now().
+ */
+
+#ifndef _SYS_CLOCK_H_
+#define _SYS_CLOCK_H_
+
+#include <stdint.h>
+
+/* Start the clock at 0 ms. cpu_hz is the COUNT frequency, above 1 MHz. */
+void sys_clock_init(uint32_t cpu_hz);
+
+/* Time since sys_clock_init(), in ms and in us. The 32-bit COUNT register is
+   extended in software: one of these must be called at least once per COUNT
+   wrap (about 89 s at 48 MHz), which the main loop does. */
+uint64_t sys_clock_ms(void);
+uint64_t sys_clock_us(void);
+
+/* Number of COUNT ticks in ms milliseconds, e.g. to set COMPARE. */
+uint32_t sys_clock_ms_to_ticks(uint32_t ms);
+
+#endif /* _SYS_CLOCK_H_ */